@@ -1,5 +1,15 @@
 
+#include <cstdlib>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "Tools/Assert.h"
+#include "Tools/Directory.h"
+#include "Tools/File.h"
 #include "Engine.h"
 #include "Namespace.h"
 #include "Parser.h"
@@ -17,6 +27,147 @@ bool Engine::load(const String& file)
   return true;
 }
 
+void Engine::addUsedPath(const String& path)
+{
+  if(!usedPaths.find(path))
+    usedPaths.append(path, 0);
+}
+
+/** Returns the modification time of a directory (or \c 0 if it does not exist) bypassing the status cache */
+static long long getWriteTime(const String& dir)
+{
+  File::invalidateStatus(dir);
+  long long writeTime;
+  if(!File::getWriteTime(dir, writeTime))
+    return 0;
+  return writeTime;
+}
+
+void Engine::findFiles(const String& pattern, List<String>& files)
+{
+  Map<String, Glob>::Node* node = globs.find(pattern);
+  if(node && !node->data.checked)
+  {
+    // use the previous result only if no file was added to or removed from the searched directories
+    for(const Map<String, long long>::Node* i = node->data.dirs.getFirst(); i; i = i->getNext())
+      if(getWriteTime(i->key) != i->data)
+      {
+        globs.remove(node);
+        node = 0;
+        break;
+      }
+    if(node)
+    {
+      node->data.checked = true;
+      for(const Map<String, long long>::Node* i = node->data.dirs.getFirst(); i; i = i->getNext())
+        addUsedPath(i->key);
+    }
+  }
+  if(!node)
+  {
+    List<String> dirs;
+    Glob& glob = globs.append(pattern);
+    Directory::findFiles(pattern, glob.files, &dirs);
+    for(const List<String>::Node* i = dirs.getFirst(); i; i = i->getNext())
+      if(!glob.dirs.find(i->data))
+      {
+        glob.dirs.append(i->data, getWriteTime(i->data));
+        addUsedPath(i->data);
+      }
+    glob.checked = true;
+    globsChanged = true;
+    files = glob.files;
+    return;
+  }
+  files = node->data.files;
+}
+
+bool Engine::loadGlobs(const String& file)
+{
+  globs.clear();
+  globsChanged = false;
+
+  File f;
+  if(!f.open(file))
+    return false;
+  String data;
+  char buffer[16384];
+  size_t i;
+  while((i = f.read(buffer, sizeof(buffer))) > 0)
+    data.append(buffer, i);
+
+  // each line is either "pattern <pattern>", "dir <writeTime> <path>" or "file <path>"
+  Glob* glob = 0;
+  for(const char* line = data.getData(), * end; *line; line = *end ? end + 1 : end)
+  {
+    end = strchr(line, '\n');
+    if(!end)
+      end = line + strlen(line);
+    if(strncmp(line, "pattern ", 8) == 0)
+      glob = &globs.append(String(line + 8, end - line - 8));
+    else if(!glob)
+      continue;
+    else if(strncmp(line, "dir ", 4) == 0)
+    {
+      char* path;
+      long long writeTime = strtoll(line + 4, &path, 10);
+      if(*path == ' ' && path < end)
+        glob->dirs.append(String(path + 1, end - path - 1), writeTime);
+    }
+    else if(strncmp(line, "file ", 5) == 0)
+      glob->files.append(String(line + 5, end - line - 5));
+  }
+  return true;
+}
+
+bool Engine::saveGlobs(const String& file)
+{
+  if(!globsChanged)
+    return true;
+  String data;
+  for(const Map<String, Glob>::Node* i = globs.getFirst(); i; i = i->getNext())
+  {
+    data.append("pattern ");
+    data.append(i->key);
+    data.append('\n');
+    for(const Map<String, long long>::Node* j = i->data.dirs.getFirst(); j; j = j->getNext())
+    {
+      data.append(String().format(32, "dir %lld ", j->data));
+      data.append(j->key);
+      data.append('\n');
+    }
+    for(const List<String>::Node* j = i->data.files.getFirst(); j; j = j->getNext())
+    {
+      data.append("file ");
+      data.append(j->data);
+      data.append('\n');
+    }
+  }
+  Directory::create(File::getDirname(file));
+#ifdef _WIN32
+  String tmpFile = file + String().format(32, ".%u.tmp", (unsigned int)GetCurrentProcessId());
+#else
+  String tmpFile = file + String().format(32, ".%u.tmp", (unsigned int)getpid());
+#endif
+  File f;
+  if(!f.open(tmpFile, File::writeFlag))
+    return false;
+  if(!f.write(data))
+  {
+    f.close();
+    File::unlink(tmpFile);
+    return false;
+  }
+  f.close();
+  if(!File::rename(tmpFile, file))
+  {
+    File::unlink(tmpFile);
+    return false;
+  }
+  globsChanged = false;
+  return true;
+}
+
 void Engine::error(const String& message)
 {
   errorHandler(errorUserData, String(), -1, message);
@@ -58,6 +209,7 @@ void Engine::enterRootKey()
 {
   Namespace* subSpace = currentSpace->enterUnnamedKey(rootStatement);
   ASSERT(subSpace);
+  subSpace->flags |= Namespace::rootFlag;
   currentSpace = subSpace;
 }
 
@@ -88,7 +240,16 @@ bool Engine::leaveKey()
     return false;
   Namespace* parent = currentSpace->getParent();
   if(currentSpace->flags & Namespace::unnamedFlag)
+  {
+    for(List<SharedRoot>::Node* i = sharedRoots.getFirst(); i; i = i->getNext())
+      if(i->data.parent == currentSpace)
+      {
+        delete i->data.space;
+        sharedRoots.remove(i);
+        break;
+      }
     delete currentSpace;
+  }
   currentSpace = parent;
   return true;
 }
@@ -103,6 +264,11 @@ void Engine::appendKeys(String& output)
   return currentSpace->appendKeys(output);
 }
 
+void Engine::appendKeys(List<Word>& keys)
+{
+  currentSpace->appendKeys(keys);
+}
+
 bool Engine::getKeys(const String& key, List<String>& keys, bool allowInheritance)
 {
   if(enterKey(key, allowInheritance))
@@ -16,9 +16,10 @@ public:
 
   typedef void (*ErrorHandler)(void* userData, const String& file, int line, const String& message);
 
-  Engine(ErrorHandler errorHandler, void* userData) : errorHandler(errorHandler), errorUserData(userData), rootStatement(0), currentSpace(0) {}
+  Engine(ErrorHandler errorHandler, void* userData) : errorHandler(errorHandler), errorUserData(userData), rootStatement(0), currentSpace(0), wroteFiles(false), globsChanged(false), watchedSpace(0), watchedSpaceUsed(false) {}
 
   bool load(const String& file);
+  bool isLoaded() const {return currentSpace != 0;}
   void error(const String& message);
 
   bool hasKey(const String& key, bool allowInheritance = true);
@@ -48,19 +49,78 @@ public:
   void pushAndLeaveKey(); // TODO: hide these functions
   bool popKey();
 
+  /** Returns the files and directories whose content was used for evaluating keys (files read with "readfile" and directories searched for wildcards) */
+  const Map<String, void*>& getUsedPaths() const {return usedPaths;}
+
+  /** Returns the environment variables that were used for evaluating keys (with their entry in the environment block or an empty string if a variable was not set) */
+  const Map<String, String>& getUsedEnvironmentVariables() const {return usedEnvironmentVariables;}
+
+  /** Returns whether files were written while evaluating keys (with "writefile") */
+  bool hasWrittenFiles() const {return wroteFiles;}
+
+  /**
+  * Loads the results of wildcard expansions of a previous evaluation. A loaded result is used if the directories
+  * that were searched for it are unchanged (which is checked when the pattern is expanded for the first time).
+  * @param file The file that was written with \c saveGlobs
+  * @return Whether the file could be read
+  */
+  bool loadGlobs(const String& file);
+
+  /**
+  * Stores the results of the wildcard expansions (unless they are unchanged since \c loadGlobs)
+  * @param file The file
+  * @return Whether the file was written or did not need to be written
+  */
+  bool saveGlobs(const String& file);
+
 private:
   ErrorHandler errorHandler;
   void* errorUserData;
   Statement* rootStatement;
   Namespace* currentSpace;
   List<Namespace*> stashedKeys;
+  Map<String, void*> usedPaths;
+  Map<String, String> usedEnvironmentVariables;
+  bool wroteFiles;
+
+  /** The result of a wildcard expansion */
+  class Glob
+  {
+  public:
+    List<String> files;
+    Map<String, long long> dirs; /**< The searched directories with their modification time (or \c 0 if they do not exist) */
+    bool checked; /**< Whether the directories were checked (or searched) since the last \c loadGlobs */
+
+    Glob() : checked(false) {}
+  };
+
+  Map<String, Glob> globs;
+  bool globsChanged;
+
+  /** The keys resulting from the root statement which can be used for all namespaces that enter it from below the same parent */
+  class SharedRoot
+  {
+  public:
+    Namespace* parent; /**< The parent of the namespace from which the root statement was entered */
+    Namespace* space; /**< The keys */
+    List<String> missingKeys; /**< The keys that were looked up but not found in the namespace from which the root statement was entered */
+  };
+
+  List<SharedRoot> sharedRoots;
+  Namespace* watchedSpace; /**< The namespace from which the root statement is currently executed */
+  bool watchedSpaceUsed; /**< Whether a key of \c watchedSpace (like "target" or "configuration") was used while executing the root statement */
+  List<String> watchedSpaceMissingKeys;
+
+  void addUsedPath(const String& path);
+  void findFiles(const String& pattern, List<String>& files);
 
   bool resolveScript(const String& key, Word*& word, Namespace*& result);
   bool resolveScript(const String& key, Namespace* excludeStatements, Word*& word, Namespace*& result);
   void setKey(const Word& key);
   void appendKeys(String& output);
+  void appendKeys(List<Word>& keys);
   
-  friend class ReferenceStatement; // hack?
-  friend class IfStatement; // hack?
+  friend class Program;
+  friend class Expression;
   friend class Namespace;
 };
@@ -0,0 +1,572 @@
+
+#include <cstring>
+#include <cctype>
+
+#include "Tools/File.h"
+#include "Tools/Directory.h"
+#include "Tools/Word.h"
+#include "Tools/Process.h"
+#include "Expression.h"
+#include "Engine.h"
+
+Expression::Expression(const String& string) : constant(true)
+{
+  if(!strchr(string.getData(), '$'))
+  {
+    text = string;
+    return;
+  }
+  const char* input = string.getData();
+  parse(input, "");
+}
+
+Expression::~Expression()
+{
+  for(const List<Chunk>::Node* i = chunks.getFirst(); i; i = i->getNext())
+  {
+    delete i->data.name;
+    for(const List<Expression*>::Node* j = i->data.arguments.getFirst(); j; j = j->getNext())
+      delete j->data;
+  }
+}
+
+void Expression::parse(const char*& input, const char* endchars)
+{
+  /*
+  string = { chunk }
+  chunk = '$(' vardecl ')' | chars
+  vardecl = string [ ' ' string { ',' string } ]
+  */
+
+  struct Literal
+  {
+    static void append(Expression& expression, const char* str, size_t length)
+    {
+      if(expression.constant)
+        expression.text.append(str, length);
+      else
+      {
+        if(expression.chunks.getLast()->data.name)
+          expression.chunks.append();
+        expression.chunks.getLast()->data.text.append(str, length);
+      }
+    }
+  };
+
+  while(*input && !strchr(endchars, *input))
+  {
+    if(*input == '$')
+    {
+      if(input[1] == '(')
+      {
+        input += 2;
+        if(constant)
+        {
+          if(!text.isEmpty())
+          {
+            chunks.append().text = text;
+            text.clear();
+          }
+          constant = false;
+        }
+        Chunk& chunk = chunks.append();
+        chunk.name = new Expression;
+        chunk.name->parse(input, " )");
+        if(*input == ' ')
+        {
+          ++input;
+          chunk.call = true;
+          chunk.function = chunk.name->constant ? getFunction(chunk.name->text) : unresolvedFunction;
+          for(;;)
+          {
+            Expression* argument = new Expression;
+            chunk.arguments.append(argument);
+            argument->parse(input, ",)");
+            if(*input != ',')
+              break;
+            ++input;
+          }
+        }
+        if(*input == ')')
+          ++input;
+      }
+      else if(input[1] == '$')
+      {
+        input += 2;
+        Literal::append(*this, "$", 1);
+      }
+      else
+        ++input; // ignore isolated $ sign
+      continue;
+    }
+
+    const char* str = input++;
+    while(*input && *input != '$' && !strchr(endchars, *input))
+      ++input;
+    Literal::append(*this, str, input - str);
+  }
+}
+
+Expression::Function Expression::getFunction(const String& name)
+{
+  static const struct
+  {
+    const char* name;
+    Function function;
+  } functions[] = {
+    {"subst", substFunction},
+    {"patsubst", patsubstFunction},
+    // TODO: strip
+    {"findstring", findstringFunction},
+    {"filter", filterFunction},
+    {"filter-out", filterOutFunction},
+    // TODO: sort, word, wordlist, words
+    {"firstword", firstwordFunction},
+    {"lastword", lastwordFunction},
+    {"dir", dirFunction},
+    {"notdir", notdirFunction},
+    {"suffix", suffixFunction},
+    {"basename", basenameFunction},
+    {"addsuffix", addsuffixFunction},
+    {"addprefix", addprefixFunction},
+    // TODO: wildcard, realpath, abspath
+    {"if", ifFunction},
+    // TODO: or, and
+    {"foreach", foreachFunction},
+    {"origin", originFunction},
+    // TODO: call, value, eval, falvor, error, warning, info?
+    {"lower", lowerFunction},
+    {"upper", upperFunction},
+    {"readfile", readfileFunction},
+    {"writefile", writefileFunction},
+  };
+  for(size_t i = 0; i < sizeof(functions) / sizeof(*functions); ++i)
+    if(strcmp(name.getData(), functions[i].name) == 0)
+      return functions[i].function;
+  return unknownFunction;
+}
+
+bool Expression::isListFunction(Function function)
+{
+  switch(function)
+  {
+  case substFunction:
+  case patsubstFunction:
+  case filterFunction:
+  case filterOutFunction:
+  case firstwordFunction:
+  case lastwordFunction:
+  case dirFunction:
+  case notdirFunction:
+  case suffixFunction:
+  case basenameFunction:
+  case addsuffixFunction:
+  case addprefixFunction:
+  case foreachFunction:
+  case lowerFunction:
+  case upperFunction:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Expression::evaluate(Engine& engine, String& output) const
+{
+  if(constant)
+  {
+    output.append(text);
+    return;
+  }
+
+  for(const List<Chunk>::Node* i = chunks.getFirst(); i; i = i->getNext())
+  {
+    const Chunk& chunk = i->data;
+    if(!chunk.name)
+      output.append(chunk.text);
+    else if(chunk.call)
+      evaluateCall(engine, chunk, output);
+    else if(chunk.name->constant)
+      evaluateVariable(engine, chunk.name->text, output);
+    else
+    {
+      String name;
+      chunk.name->evaluate(engine, name);
+      evaluateVariable(engine, name, output);
+    }
+  }
+}
+
+void Expression::evaluate(Engine& engine, List<Word>& words) const
+{
+  if(constant)
+  {
+    Word::split(text, words);
+    return;
+  }
+
+  // pass on the words of a single function call or variable reference
+  if(chunks.getSize() == 1)
+  {
+    const Chunk& chunk = chunks.getFirst()->data;
+    if(chunk.name && chunk.name->constant && (!chunk.call || isListFunction(chunk.function)))
+    {
+      List<Word>::Node* last = words.getLast();
+      if(chunk.call)
+        evaluateListCall(engine, chunk, chunk.function, words);
+      else
+        evaluateVariable(engine, chunk.name->text, words);
+      normalizeWords(words, last ? last->getNext() : words.getFirst());
+      return;
+    }
+  }
+
+  String output;
+  evaluate(engine, output);
+  Word::split(output, words);
+}
+
+void Expression::normalizeWords(List<Word>& words, List<Word>::Node* first)
+{
+  // find words that would not be split into the same words again (like words with spaces or empty words)
+  List<Word>::Node* i = first;
+  for(; i; i = i->getNext())
+  {
+    const Word& word = i->data;
+    if(word.isEmpty())
+      break;
+    const char* str = word.getData();
+    if(word.flags & Word::quotedFlag)
+    {
+      if(strchr(str, '"') || str[word.getLength() - 1] == '\\')
+        break;
+    }
+    else
+    {
+      if(*str == '"')
+        break;
+      for(; *str; ++str)
+        if(isspace(*(unsigned char*)str))
+          break;
+      if(*str)
+        break;
+    }
+    i->data.flags &= Word::quotedFlag;
+  }
+  if(!i)
+    return;
+
+  // join and split the remaining words
+  String text;
+  for(List<Word>::Node* next; i; i = next)
+  {
+    next = i->getNext();
+    if(!text.isEmpty())
+      text.append(' ');
+    i->data.appendTo(text);
+    words.remove(i);
+  }
+  Word::split(text, words);
+}
+
+void Expression::evaluateArgument(Engine& engine, const Chunk& chunk, unsigned int index, String& output)
+{
+  const List<Expression*>::Node* i = chunk.arguments.getFirst();
+  for(; i && index > 0; --index)
+    i = i->getNext();
+  if(i)
+    i->data->evaluate(engine, output);
+}
+
+void Expression::evaluateArgument(Engine& engine, const Chunk& chunk, unsigned int index, List<Word>& words)
+{
+  const List<Expression*>::Node* i = chunk.arguments.getFirst();
+  for(; i && index > 0; --index)
+    i = i->getNext();
+  if(i)
+    i->data->evaluate(engine, words);
+}
+
+void Expression::evaluateCall(Engine& engine, const Chunk& chunk, String& output) const
+{
+  Function function = chunk.function;
+  if(function == unresolvedFunction)
+  {
+    String name;
+    chunk.name->evaluate(engine, name);
+    function = getFunction(name);
+  }
+
+  if(isListFunction(function))
+  {
+    List<Word> words;
+    evaluateListCall(engine, chunk, function, words);
+    Word::append(words, output);
+    return;
+  }
+
+  switch(function)
+  {
+  case findstringFunction:
+    {
+      String find, in;
+      evaluateArgument(engine, chunk, 0, find);
+      evaluateArgument(engine, chunk, 1, in);
+
+      if(in.contains(find))
+        output.append(find);
+    }
+    break;
+  case ifFunction:
+    {
+      String condition;
+      evaluateArgument(engine, chunk, 0, condition);
+      evaluateArgument(engine, chunk, condition.isEmpty() ? 2 : 1, output);
+    }
+    break;
+  case originFunction:
+    {
+      String var;
+      evaluateArgument(engine, chunk, 0, var);
+
+      engine.pushAndLeaveKey();
+      output.append(engine.getKeyOrigin(var));
+      engine.popKey();
+    }
+    break;
+  case readfileFunction:
+    {
+      String filepath;
+      evaluateArgument(engine, chunk, 0, filepath);
+
+      engine.addUsedPath(filepath);
+      File file;
+      if(file.open(filepath))
+      {
+        char buffer[2048];
+        size_t i;
+        while((i = file.read(buffer, sizeof(buffer))) > 0)
+          output.append(buffer, i);
+      }
+    }
+    break;
+  case writefileFunction:
+    {
+      String filepath;
+      String contents;
+      evaluateArgument(engine, chunk, 0, filepath);
+      evaluateArgument(engine, chunk, 1, contents);
+
+      engine.wroteFiles = true;
+      Directory::create(File::getDirname(filepath));
+
+      File file;
+      if(file.open(filepath, File::writeFlag) && file.write(contents))
+      {
+        // everything went well
+      }
+      else
+      {
+        // something went wrong.
+        // but apparently you are not supposed to report errors here.
+        // so I don't care. sorry.
+      }
+      output.append(filepath);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void Expression::evaluateListCall(Engine& engine, const Chunk& chunk, Function function, List<Word>& words)
+{
+  switch(function)
+  {
+  case substFunction:
+    {
+      String from, to;
+      evaluateArgument(engine, chunk, 0, from);
+      evaluateArgument(engine, chunk, 1, to);
+      List<Word>::Node* last = words.getLast();
+      evaluateArgument(engine, chunk, 2, words);
+
+      for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(); i; i = i->getNext())
+        i->data.subst(from, to);
+    }
+    break;
+  case patsubstFunction:
+    {
+      String pattern, replace;
+      evaluateArgument(engine, chunk, 0, pattern);
+      evaluateArgument(engine, chunk, 1, replace);
+      List<Word>::Node* last = words.getLast();
+      evaluateArgument(engine, chunk, 2, words);
+
+      for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(); i; i = i->getNext())
+        i->data.patsubst(pattern, replace);
+    }
+    break;
+  case filterFunction:
+  case filterOutFunction:
+    {
+      List<Word> patternwords;
+      evaluateArgument(engine, chunk, 0, patternwords);
+      List<Word>::Node* last = words.getLast();
+      evaluateArgument(engine, chunk, 1, words);
+
+      if(function == filterFunction)
+        for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(), * next; i; i = next)
+        {
+          next = i->getNext();
+          for(List<Word>::Node* j = patternwords.getFirst(); j; j = j->getNext())
+            if(i->data.patmatch(j->data))
+              goto keepWord;
+          words.remove(i);
+        keepWord: ;
+        }
+      else
+        for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(), * next; i; i = next)
+        {
+          next = i->getNext();
+          for(List<Word>::Node* j = patternwords.getFirst(); j; j = j->getNext())
+            if(i->data.patmatch(j->data))
+            {
+              words.remove(i);
+              break;
+            }
+        }
+    }
+    break;
+  case firstwordFunction:
+  case lastwordFunction:
+    {
+      List<Word> textwords;
+      evaluateArgument(engine, chunk, 0, textwords);
+
+      if(!textwords.isEmpty())
+        words.append((function == firstwordFunction ? textwords.getFirst() : textwords.getLast())->data);
+    }
+    break;
+  case dirFunction:
+  case notdirFunction:
+  case suffixFunction:
+  case basenameFunction:
+    {
+      List<Word>::Node* last = words.getLast();
+      evaluateArgument(engine, chunk, 0, words);
+
+      for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(); i; i = i->getNext())
+        switch(function)
+        {
+        case dirFunction: i->data = File::getDirname(i->data); break;
+        case notdirFunction: i->data = File::getBasename(i->data); break;
+        case suffixFunction: i->data = File::getExtension(i->data); break;
+        default: i->data = File::getWithoutExtension(i->data); break;
+        }
+    }
+    break;
+  case addsuffixFunction:
+    {
+      String suffix;
+      evaluateArgument(engine, chunk, 0, suffix);
+      List<Word>::Node* last = words.getLast();
+      evaluateArgument(engine, chunk, 1, words);
+
+      for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(); i; i = i->getNext())
+        ((String&)i->data).append(suffix);
+    }
+    break;
+  case addprefixFunction:
+    {
+      String prefix;
+      evaluateArgument(engine, chunk, 0, prefix);
+      List<Word>::Node* last = words.getLast();
+      evaluateArgument(engine, chunk, 1, words);
+
+      for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(); i; i = i->getNext())
+        i->data.prepend(prefix);
+    }
+    break;
+  case foreachFunction:
+    {
+      String var;
+      evaluateArgument(engine, chunk, 0, var);
+      List<Word>::Node* last = words.getLast();
+      evaluateArgument(engine, chunk, 1, words);
+
+      engine.pushAndLeaveKey();
+      engine.enterUnnamedKey();
+      engine.enterNewKey(var);
+      for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(); i; i = i->getNext())
+      {
+        engine.setKey(i->data);
+        engine.pushAndLeaveKey();
+        engine.enterUnnamedKey();
+        i->data.clear();
+        evaluateArgument(engine, chunk, 2, i->data);
+        engine.leaveKey(); // unnamed
+        engine.popKey();
+      }
+      engine.leaveKey();
+      engine.leaveKey(); // unnamed
+      engine.popKey();
+    }
+    break;
+  case lowerFunction:
+  case upperFunction:
+    {
+      List<Word>::Node* last = words.getLast();
+      evaluateArgument(engine, chunk, 0, words);
+
+      for(List<Word>::Node* i = last ? last->getNext() : words.getFirst(); i; i = i->getNext())
+        if(function == lowerFunction)
+          i->data.lowercase();
+        else
+          i->data.uppercase();
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void Expression::evaluateVariable(Engine& engine, const String& variable, String& output)
+{
+  engine.pushAndLeaveKey();
+  if(engine.enterKey(variable, true))
+  {
+    engine.appendKeys(output);
+    engine.leaveKey();
+  }
+  else
+    evaluateEnvironmentVariable(engine, variable, output);
+  engine.popKey();
+}
+
+void Expression::evaluateVariable(Engine& engine, const String& variable, List<Word>& words)
+{
+  engine.pushAndLeaveKey();
+  if(engine.enterKey(variable, true))
+  {
+    engine.appendKeys(words);
+    engine.leaveKey();
+  }
+  else
+  {
+    String output;
+    evaluateEnvironmentVariable(engine, variable, output);
+    Word::split(output, words);
+  }
+  engine.popKey();
+}
+
+void Expression::evaluateEnvironmentVariable(Engine& engine, const String& variable, String& output)
+{
+  const Map<String, String>& envs = Process::getEnvironmentVariables();
+  const Map<String, String>::Node* envNode = envs.find(variable);
+  if(!engine.usedEnvironmentVariables.find(variable))
+    engine.usedEnvironmentVariables.append(variable, envNode ? envNode->data : String());
+  if(envNode)
+    output.append(envNode->data.getData() + envNode->key.getLength() + 1, envNode->data.getLength() - (envNode->key.getLength() + 1));
+}
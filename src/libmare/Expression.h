@@ -0,0 +1,103 @@
+
+#pragma once
+
+#include "Tools/Word.h"
+
+class Engine;
+
+/**
+* A key string with variable references and function calls ("$(...)"), which is parsed once and can be evaluated
+* repeatedly
+*/
+class Expression
+{
+public:
+  /**
+  * @param string The key string
+  */
+  Expression(const String& string);
+
+  ~Expression();
+
+  /** Returns whether the string does not contain anything to evaluate */
+  inline bool isConstant() const {return constant;}
+
+  /** Returns the value of a constant expression */
+  inline const String& getText() const {return text;}
+
+  /**
+  * Evaluates the expression
+  * @param engine The engine that is used to look up variables
+  * @param output The string to which the value is appended
+  */
+  void evaluate(Engine& engine, String& output) const;
+
+  /**
+  * Evaluates the expression into words (like splitting the value with \c Word::split). Nested function calls and variable
+  * references pass their words on without joining and splitting them again.
+  * @param engine The engine that is used to look up variables
+  * @param words The list to which the words are appended
+  */
+  void evaluate(Engine& engine, List<Word>& words) const;
+
+private:
+  enum Function
+  {
+    unknownFunction,
+    unresolvedFunction, /**< The name of the function is not constant */
+    substFunction,
+    patsubstFunction,
+    findstringFunction,
+    filterFunction,
+    filterOutFunction,
+    firstwordFunction,
+    lastwordFunction,
+    dirFunction,
+    notdirFunction,
+    suffixFunction,
+    basenameFunction,
+    addsuffixFunction,
+    addprefixFunction,
+    ifFunction,
+    foreachFunction,
+    originFunction,
+    lowerFunction,
+    upperFunction,
+    readfileFunction,
+    writefileFunction,
+  };
+
+  /** A literal text, a variable reference or a function call */
+  class Chunk
+  {
+  public:
+    String text; /**< The literal text */
+    Expression* name; /**< The name of the variable or function or \c 0 if the chunk is a literal text */
+    bool call; /**< Whether the chunk is a function call */
+    Function function;
+    List<Expression*> arguments;
+
+    Chunk() : name(0), call(false), function(unknownFunction) {}
+  };
+
+  bool constant;
+  String text;
+  List<Chunk> chunks;
+
+  Expression() : constant(true) {}
+
+  void parse(const char*& input, const char* endchars);
+  void evaluateCall(Engine& engine, const Chunk& chunk, String& output) const;
+
+  static Function getFunction(const String& name);
+  static bool isListFunction(Function function);
+  static void evaluateListCall(Engine& engine, const Chunk& chunk, Function function, List<Word>& words);
+  static void evaluateArgument(Engine& engine, const Chunk& chunk, unsigned int index, String& output);
+  static void evaluateArgument(Engine& engine, const Chunk& chunk, unsigned int index, List<Word>& words);
+  static void evaluateVariable(Engine& engine, const String& name, String& output);
+  static void evaluateVariable(Engine& engine, const String& name, List<Word>& words);
+  static void evaluateEnvironmentVariable(Engine& engine, const String& name, String& output);
+
+  /** Turns words into the words that would result from joining them with \c Word::append and splitting them again */
+  static void normalizeWords(List<Word>& words, List<Word>::Node* first);
+};
@@ -2,383 +2,21 @@
 #include <cstring>
 
 #include "Tools/Assert.h"
-#include "Tools/File.h"
-#include "Tools/Directory.h"
 #include "Tools/Word.h"
-#include "Tools/Process.h"
 #include "Namespace.h"
+#include "Expression.h"
 #include "Statement.h"
 #include "Engine.h"
 #include "Parser.h"
 
-String Namespace::evaluateString(const String& string) const
-{
-  /*
-  string = { chunk }
-  chunk = '$(' vardecl ')' | chars
-  vardecl = string [ ' ' string { ',' string } ]
-  */
-
-  struct ParserAndInterpreter
-  {
-    static void handle(Engine& engine, const char*& input, String& output, const char* endchars, bool evaluate = true)
-    {
-      while(*input && !strchr(endchars, *input))
-      {
-        if(*input == '$')
-        {
-          if(input[1] == '(')
-          {
-            input += 2;
-            String varOrCommand;
-            handle(engine, input, varOrCommand, " )", evaluate);
-            if(*input == ' ')
-            {
-              ++input;
-              if(evaluate)
-                handleCommand(engine, varOrCommand, input, output);
-
-              // skip further arguements
-              if(*input && *input != ')')
-                for(;;)
-                {
-                  handle(engine, input, output, ",)", false);
-                  if(*input != ',')
-                    break;
-                  ++input;
-                }
-            }
-            else
-            {
-              if(evaluate)
-                handleVariable(engine, varOrCommand, output);
-            }
-            if(*input == ')')
-              ++input;
-          }
-          else if(input[1] == '$')
-          {
-            input += 2;
-            if(evaluate)
-              output.append('$');;
-          }
-          else
-            ++input; // ignore isolated $ sign
-          continue;
-        }
-
-        const char* str = input++;
-        while(*input && *input != '$' && !strchr(endchars, *input))
-          ++input;
-        if(evaluate)
-          output.append(str, input - str);
-      }
-    }
-    static void handleCommand(Engine& engine, const String& cmd, const char*& input, String& output)
-    {
-      if(cmd == "subst")
-      {
-        String from, to, text;
-        handle(engine, input, from, ",)"); if(*input == ',') ++input;
-        handle(engine, input, to, ",)"); if(*input == ',') ++input;
-        handle(engine, input, text, ",)"); if(*input == ',') ++input;
-
-        List<Word> words;
-        Word::split(text, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data.subst(from, to);
-        Word::append(words, output);
-      }
-      else if(cmd == "patsubst")
-      {
-        String pattern, replace, text;
-        handle(engine, input, pattern, ",)"); if(*input == ',') ++input;
-        handle(engine, input, replace, ",)"); if(*input == ',') ++input;
-        handle(engine, input, text, ",)"); if(*input == ',') ++input;
-
-        List<Word> words;
-        Word::split(text, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data.patsubst(pattern, replace);
-        Word::append(words, output);
-      }
-      // TODO: strip
-      else if(cmd == "findstring")
-      {
-        String find, in;
-        handle(engine, input, find, ",)"); if(*input == ',') ++input;
-        handle(engine, input, in, ",)"); if(*input == ',') ++input;
-
-        if(in.contains(find))
-          output.append(find);
-      }
-      else if(cmd == "filter" || cmd == "filter-out")
-      {
-        String pattern, text;
-        handle(engine, input, pattern, ",)"); if(*input == ',') ++input;
-        handle(engine, input, text, ",)"); if(*input == ',') ++input;
-
-        List<Word> patternwords, words;
-        Word::split(pattern, patternwords);
-        Word::split(text, words);
-        if(cmd == "filter")
-          for(List<Word>::Node* i = words.getFirst(), * next; i; i = next)
-          {
-            next = i->getNext();
-            for(List<Word>::Node* j = patternwords.getFirst(); j; j = j->getNext())
-              if(i->data.patmatch(j->data))
-                goto keepWord;
-            words.remove(i);
-          keepWord: ;
-          }
-        else
-          for(List<Word>::Node* i = words.getFirst(), * next; i; i = next)
-          {
-            next = i->getNext();
-            for(List<Word>::Node* j = patternwords.getFirst(); j; j = j->getNext())
-              if(i->data.patmatch(j->data))
-              {
-                words.remove(i);
-                break;
-              }
-          }
-        Word::append(words, output);
-      }
-      // TODO: sort, word, wordlist, words
-      else if(cmd == "firstword")
-      {
-        String text;
-        handle(engine, input, text, ",)"); if(*input == ',') ++input;
-
-        List<Word> words;
-        Word::split(text, words);
-        if(!words.isEmpty())
-          words.getFirst()->data.appendTo(output);
-      }
-      else if(cmd == "lastword")
-      {
-        String text;
-        handle(engine, input, text, ",)"); if(*input == ',') ++input;
-
-        List<Word> words;
-        Word::split(text, words);
-        if(!words.isEmpty())
-          words.getLast()->data.appendTo(output);
-      }
-      else if(cmd == "dir")
-      {
-        String files;
-        handle(engine, input, files, ",)"); if(*input == ',') ++input;
-
-        List<Word> words;
-        Word::split(files, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data = File::getDirname(i->data);
-        Word::append(words, output);
-      }
-      else if(cmd == "notdir")
-      {
-        String files;
-        handle(engine, input, files, ",)"); if(*input == ',') ++input;
-        
-        List<Word> words;
-        Word::split(files, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data = File::getBasename(i->data);
-        Word::append(words, output);
-      }
-      else if(cmd == "suffix")
-      {
-        String files;
-        handle(engine, input, files, ",)"); if(*input == ',') ++input;
-        
-        List<Word> words;
-        Word::split(files, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data = File::getExtension(i->data);
-        Word::append(words, output);
-      }
-      else if(cmd == "basename")
-      {
-        String files;
-        handle(engine, input, files, ",)"); if(*input == ',') ++input;
-        
-        List<Word> words;
-        Word::split(files, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data = File::getWithoutExtension(i->data);
-        Word::append(words, output);
-      }
-      else if(cmd == "addsuffix")
-      {
-        String suffix, files;
-        handle(engine, input, suffix, ",)"); if(*input == ',') ++input;
-        handle(engine, input, files, ",)"); if(*input == ',') ++input;
-        
-        List<Word> words;
-        Word::split(files, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          ((String&)i->data).append(suffix);
-        Word::append(words, output);
-      }
-      else if(cmd == "addprefix")
-      {
-        String prefix, files;
-        handle(engine, input, prefix, ",)"); if(*input == ',') ++input;
-        handle(engine, input, files, ",)"); if(*input == ',') ++input;
-        
-        List<Word> words;
-        Word::split(files, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data.prepend(prefix);
-        Word::append(words, output);
-      }
-      // TODO: wildcard, realpath, abspath
-      else if(cmd == "if")
-      {
-        String condition;
-        handle(engine, input, condition, ",)"); if(*input == ',') ++input;
-        if(!condition.isEmpty())
-        { // then
-          handle(engine, input, output, ",)"); if(*input == ',') ++input;
-          handle(engine, input, output, ",)", false); if(*input == ',') ++input;
-        }
-        else
-        {
-          handle(engine, input, output, ",)", false); if(*input == ',') ++input;
-          handle(engine, input, output, ",)"); if(*input == ',') ++input;
-        }
-      }
-      // TODO: or, and
-      else if(cmd == "foreach")
-      {
-        String var, list;
-        handle(engine, input, var, ",)"); if(*input == ',') ++input;
-        handle(engine, input, list, ",)"); if(*input == ',') ++input;
-
-        List<Word> words;
-        Word::split(list, words);
-        const char* inputStart = input;
-        engine.pushAndLeaveKey();
-        engine.enterUnnamedKey();
-        engine.enterNewKey(var);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-        {
-          engine.setKey(i->data);
-          engine.pushAndLeaveKey();
-          engine.enterUnnamedKey();
-          input = inputStart;
-          i->data.clear();
-          handle(engine, input, i->data, ",)");
-          engine.leaveKey(); // unnamed
-          engine.popKey();
-        }
-        engine.leaveKey();
-        engine.leaveKey(); // unnamed
-        engine.popKey();
-        if(*input == ',') ++input;
-        Word::append(words, output);
-      }
-      else if(cmd == "origin")
-      {
-        String var;
-        handle(engine, input, var, ",)"); if(*input == ',') ++input;
-
-        engine.pushAndLeaveKey();
-        output.append(engine.getKeyOrigin(var));
-        engine.popKey();
-      }
-      // TODO: call, value, eval, falvor, error, warning, info?
-      else if(cmd == "lower")
-      {
-        String text;
-        handle(engine, input, text, ",)"); if(*input == ',') ++input;
-        
-        List<Word> words;
-        Word::split(text, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data.lowercase();
-        Word::append(words, output);
-      }
-      else if(cmd == "upper")
-      {
-        String text;
-        handle(engine, input, text, ",)"); if(*input == ',') ++input;
-        
-        List<Word> words;
-        Word::split(text, words);
-        for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-          i->data.uppercase();
-        Word::append(words, output);
-      }
-      else if(cmd == "readfile")
-      {
-        String filepath;
-        handle(engine, input, filepath, ",)"); if(*input == ',') ++input;
-
-        File file;
-        if(file.open(filepath))
-        {
-          char buffer[2048];
-          size_t i;
-          while((i = file.read(buffer, sizeof(buffer))) > 0)
-            output.append(buffer, i);
-        }
-      }
-      else if(cmd == "writefile")
-      {
-        String filepath;
-        String contents;
-        handle(engine, input, filepath, ",)"); if(*input == ',') ++input;
-        handle(engine, input, contents, ",)"); if(*input == ',') ++input;
-
-        Directory::create(File::getDirname(filepath));
-
-        File file;
-        if(file.open(filepath, File::writeFlag) && file.write(contents))
-        {
-          // everything went well
-        } 
-        else
-        {
-          // something went wrong.
-          // but apparently you are not supposed to report errors here.
-          // so I don't care. sorry.
-        }
-        output.append(filepath);
-      }
-    }
-    static void handleVariable(Engine& engine, const String& variable, String& output)
-    {
-      engine.pushAndLeaveKey();
-      if(engine.enterKey(variable, true))
-      {
-        engine.appendKeys(output);
-        engine.leaveKey();
-      }
-      else
-      {
-        const Map<String, String>& envs = Process::getEnvironmentVariables();
-        const Map<String, String>::Node* envNode = envs.find(variable);
-        if(envNode)
-          output.append(envNode->data.getData() + envNode->key.getLength() + 1, envNode->data.getLength() - (envNode->key.getLength() + 1));
-      }
-      engine.popKey();
-    }
-  };
-
-  String result;
-  const char* strData = string.getData();
-  ParserAndInterpreter::handle(*engine, strData, result, "");
-  return result;
-}
-
 Namespace* Namespace::enterKey(const String& name, bool allowInheritance)
 {
   compile();
 
   Word key(name, 0);
   Map<Word, Namespace*>::Node* j = variables.find(key);
+  if(engine->watchedSpace == this)
+    watchKey(key, j);
   if(j)
   {
     if(!j->data)
@@ -464,6 +102,8 @@ bool Namespace::resolveScript2(const String& name, Word*& word, Namespace*& resu
   // try a local lookup
   Word key(name, 0);
   Map<Word, Namespace*>::Node* node = variables.find(key);
+  if(engine->watchedSpace == this)
+    watchKey(key, node);
   if(node)
   {
     result = node->data;
@@ -489,6 +129,8 @@ bool Namespace::resolveScript2(const String& name, Namespace* excludeStatements,
   // try a local lookup
   Word key(name, 0);
   Map<Word, Namespace*>::Node* node = variables.find(key);
+  if(engine->watchedSpace == this)
+    watchKey(key, node);
   if(node)
   {
     result = node->data;
@@ -513,78 +155,42 @@ bool Namespace::resolveScript2(const String& name, Namespace* excludeStatements,
   return false;
 }
 
-void Namespace::addKey(const String& key, unsigned int wordFlags, Statement* value, Token::Id operation)
+void Namespace::getKeyWords(const Expression& key, unsigned int wordFlags, bool textMode, bool remove, List<Word>& words) const
 {
-  // evaluate variables
-  String evaluatedKey = evaluateString(key);
-
   // textMode?
-  if(flags & textModeFlag)
+  if(textMode)
   {
-    List<Word> words;
-    Word::splitLines(evaluatedKey, words);
-    for(const List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-      addKeyRaw(i->data, 0, operation);
-    return;
-  }
-
-  // split words
-  List<Word> words;
-  Word::split(evaluatedKey, words);
-
-  // add each word
-  for(List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-  {
-    Word& word = i->data;
-    word.flags |= wordFlags;
-
-    // expand wildcards
-    if(word.flags == 0 && strpbrk(word.getData(), "*?")) 
-    {
-      List<String> files;
-      Directory::findFiles(word, files);
-      for(const List<String>::Node* i = files.getFirst(); i; i = i->getNext())
-        addKeyRaw(Word(i->data, 0), value, operation);
-    }
+    // evaluate variables
+    String evaluatedKey;
+    if(key.isConstant())
+      evaluatedKey = key.getText();
     else
-      addKeyRaw(word, value, operation);
-  }
-}
-
-void Namespace::removeKey(const String& key)
-{
-  // evaluate variables
-  String evaluatedKey = evaluateString(key);
+      key.evaluate(*engine, evaluatedKey);
 
-  // textMode?
-  if(flags & textModeFlag)
-  {
-    List<Word> words;
     Word::splitLines(evaluatedKey, words);
-    for(const List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
-      removeKeyRaw(i->data);
     return;
   }
 
-  // split words
-  List<Word> words;
-  Word::split(evaluatedKey, words);
+  // evaluate variables and split words
+  List<Word> splitWords;
+  key.evaluate(*engine, splitWords);
 
   // add each word
-  for(const List<Word>::Node* i = words.getFirst(); i; i = i->getNext())
+  for(List<Word>::Node* i = splitWords.getFirst(); i; i = i->getNext())
   {
-    const Word& word = i->data;
+    Word& word = i->data;
+    word.flags |= wordFlags;
 
     // expand wildcards
-    if(!(word.flags & Word::quotedFlag) && strpbrk(word.getData(), "*?")) 
+    if((remove ? !(word.flags & Word::quotedFlag) : word.flags == 0) && strpbrk(word.getData(), "*?"))
     {
       List<String> files;
-      Directory::findFiles(word, files);
+      engine->findFiles(word, files);
       for(const List<String>::Node* i = files.getFirst(); i; i = i->getNext())
-        removeKeyRaw(i->data);
+        words.append(Word(i->data, 0));
     }
     else
-      removeKeyRaw(word);
+      words.append(word);
   }
 }
 
@@ -814,6 +420,17 @@ void Namespace::appendKeys(String& output)
   }
 }
 
+void Namespace::appendKeys(List<Word>& keys)
+{
+  compile();
+  for(Map<Word, Namespace*>::Node* i = variables.getFirst(); i; i = i->getNext())
+  {
+    if(i->data && (i->data->flags & inheritedFlag))
+      break;
+    keys.append(i->key);
+  }
+}
+
 String Namespace::getFirstKey()
 {
   compile();
@@ -843,6 +460,11 @@ void Namespace::compile()
     ASSERT(false);
     return;
   }
+  if((flags & rootFlag) && statement && !defaultStatement && !(flags & textModeFlag))
+  {
+    compileRoot();
+    return;
+  }
   flags |= compilingFlag;
   if(defaultStatement)
     defaultStatement->execute(*this);
@@ -851,3 +473,95 @@ void Namespace::compile()
   flags &= ~compilingFlag;
   flags |= compiledFlag;
 }
+
+void Namespace::compileRoot()
+{
+  // use the keys of a previous execution of the root statement that did not depend on the keys of the parent namespace
+  // (which is the case for another target, configuration or platform as long as the parent has none of the keys that were looked up)
+  parent->compile();
+  bool freshParent = true;
+  for(const Map<Word, Namespace*>::Node* i = parent->variables.getFirst(); i; i = i->getNext())
+    if(i->data && (i->data->flags & inheritedFlag))
+    {
+      freshParent = false;
+      break;
+    }
+  if(freshParent)
+    for(const List<Engine::SharedRoot>::Node* i = engine->sharedRoots.getFirst(); i; i = i->getNext())
+      if(i->data.parent == parent->parent)
+      {
+        const List<String>::Node* j = i->data.missingKeys.getFirst();
+        for(; j; j = j->getNext())
+          if(parent->variables.find(Word(j->data, 0)))
+            break;
+        if(j)
+          break;
+        i->data.space->copyKeys(*this);
+        flags |= compiledFlag;
+        return;
+      }
+
+  // execute the root statement and watch the lookups in the parent namespace
+  bool watch = freshParent && !engine->watchedSpace;
+  bool wroteFiles = engine->wroteFiles;
+  if(watch)
+  {
+    engine->watchedSpace = parent;
+    engine->watchedSpaceUsed = false;
+    engine->watchedSpaceMissingKeys.clear();
+  }
+  flags |= compilingFlag;
+  statement->execute(*this);
+  if(watch)
+  {
+    engine->watchedSpace = 0;
+    if(!engine->watchedSpaceUsed && engine->wroteFiles == wroteFiles)
+    {
+      // execute the root statement once more to get keys that are owned by the engine and share them with other targets
+      List<Engine::SharedRoot>::Node* i = engine->sharedRoots.getFirst();
+      for(; i; i = i->getNext())
+        if(i->data.parent == parent->parent)
+          break;
+      if(!i)
+      {
+        Engine::SharedRoot& sharedRoot = engine->sharedRoots.append(Engine::SharedRoot());
+        sharedRoot.parent = parent->parent;
+        sharedRoot.space = new Namespace(*engine, 0, engine, statement, 0, compilingFlag);
+        sharedRoot.missingKeys = engine->watchedSpaceMissingKeys;
+        statement->execute(*sharedRoot.space);
+        sharedRoot.space->flags = compiledFlag;
+      }
+    }
+  }
+  flags &= ~compilingFlag;
+  flags |= compiledFlag;
+}
+
+void Namespace::copyKeys(Namespace& space) const
+{
+  struct Copier
+  {
+    static Namespace* copy(const Namespace* src, const Namespace& owner, Namespace& parent)
+    {
+      if(!src)
+        return 0;
+      Scope& scope = &src->scope == &owner ? parent : src->scope;
+      return new Namespace(scope, &parent, src->engine, src->statement, copy(src->next, owner, parent), src->flags & ~(compiledFlag | compilingFlag));
+    }
+  };
+  for(const Map<Word, Namespace*>::Node* i = variables.getFirst(); i; i = i->getNext())
+    space.variables.append(i->key, Copier::copy(i->data, *this, space));
+}
+
+void Namespace::watchKey(const Word& key, const Map<Word, Namespace*>::Node* node)
+{
+  if(node && !(node->data && (node->data->flags & inheritedFlag)))
+  {
+    engine->watchedSpaceUsed = true;
+    return;
+  }
+  for(const List<String>::Node* i = engine->watchedSpaceMissingKeys.getFirst(); i; i = i->getNext())
+    if(i->data == key)
+      return;
+  engine->watchedSpaceMissingKeys.append(key);
+}
@@ -8,6 +8,7 @@
 
 class Engine;
 class Statement;
+class Expression;
 
 class Namespace : public Scope, public Scope::Object
 {
@@ -24,15 +25,14 @@ public:
   void getKeys(List<String>& keys);
   void getText(List<String>& text);
   void appendKeys(String& output);
+  void appendKeys(List<Word>& keys);
   String getFirstKey();
   String getMareDir() const;
   inline Engine& getEngine() {return *engine;}
 
-  void addKey(const String& key, unsigned int flags, Statement* value, Token::Id operation = Token::assignment);
   void addKeyRaw(const Word& key, Statement* value, Token::Id operation = Token::assignment);
   void setKeyRaw(const Word& key);
   void removeAllKeys();
-  void removeKey(const String& key);
   void removeKeyRaw(const String& key);
   void removeKeysRaw(Namespace& space);
   bool compareKeys(Namespace& space, bool& result);
@@ -51,6 +51,7 @@ private:
     compilingFlag = (1 << 3),
     unnamedFlag = (1 << 4),
     textModeFlag = (1 << 5),
+    rootFlag = (1 << 6),
   };
 
   Namespace* parent;
@@ -62,8 +63,19 @@ private:
   Map<Word, Namespace*> variables;
 
   void compile();
-  String evaluateString(const String& string) const;
+  void compileRoot();
+  void copyKeys(Namespace& space) const;
+  void watchKey(const Word& key, const Map<Word, Namespace*>::Node* node);
+  /**
+  * Evaluates a key string and splits it into keys
+  * @param key The parsed key string
+  * @param wordFlags Flags for the keys
+  * @param textMode Whether each line is a key
+  * @param remove Whether the keys are going to be removed (which expands wildcards in unquoted keys with flags)
+  * @param words The keys
+  */
+  void getKeyWords(const Expression& key, unsigned int wordFlags, bool textMode, bool remove, List<Word>& words) const;
 
   friend class Engine;
-  friend class ReferenceStatement; // temporary hack
+  friend class Program;
 };
@@ -0,0 +1,199 @@
+
+#include <cstdlib>
+
+#include "Tools/Assert.h"
+#include "Program.h"
+#include "Expression.h"
+#include "Statement.h"
+#include "Namespace.h"
+#include "Engine.h"
+
+/** Adds a key to a temporary key list (like a namespace, a list keeps the position of a key that is added again) */
+static void addKey(List<Word>& keys, const Word& key)
+{
+  for(const List<Word>::Node* i = keys.getFirst(); i; i = i->getNext())
+    if(i->data == key)
+      return;
+  keys.append(key);
+}
+
+static void removeKey(List<Word>& keys, const Word& key)
+{
+  for(List<Word>::Node* i = keys.getFirst(); i; i = i->getNext())
+    if(i->data == key)
+    {
+      keys.remove(i);
+      return;
+    }
+}
+
+Program::~Program()
+{
+  for(const Instruction* i = instructions.getFirst(), * end = i + instructions.getSize(); i < end; ++i)
+  {
+    delete i->expression;
+    delete i->combinedValues;
+  }
+}
+
+Program::Instruction& Program::append(Opcode opcode, Statement* statement)
+{
+  Instruction& instruction = instructions.append();
+  instruction.opcode = opcode;
+  instruction.statement = statement;
+  return instruction;
+}
+
+Statement* Program::getCombinedValue(const Instruction& instruction, const Word& key) const
+{
+  Map<String, Statement*>*& combinedValues = const_cast<Instruction&>(instruction).combinedValues;
+  if(!combinedValues)
+    combinedValues = new Map<String, Statement*>;
+  Map<String, Statement*>::Node* node = combinedValues->find(key);
+  if(node)
+    return node->data;
+
+  // "key += value" means "key = key value" and "key -= value" means "key = key - value"
+  Scope& scope = instruction.statement->scope;
+  BinaryStatement* binaryStatement = new BinaryStatement(scope);
+  binaryStatement->operation = instruction.operation == Token::plusAssignment ? Token::plus : Token::minus;
+  ReferenceStatement* referenceStatement = new ReferenceStatement(scope);
+  referenceStatement->variable = key;
+  binaryStatement->leftOperand = referenceStatement;
+  binaryStatement->rightOperand = instruction.value;
+  combinedValues->append(key, binaryStatement);
+  return binaryStatement;
+}
+
+void Program::run(Namespace& space, List<Word>* keys) const
+{
+  List<List<Word> > lists;
+  bool textMode = !keys && (space.flags & Namespace::textModeFlag);
+  const Instruction* begin = instructions.getFirst();
+  for(const Instruction* i = begin, * end = begin + instructions.getSize(); i < end; ++i)
+  {
+    List<Word>* target = lists.isEmpty() ? keys : &lists.getLast()->data;
+    switch(i->opcode)
+    {
+    case addKeyOp:
+      {
+        List<Word> words;
+        space.getKeyWords(*i->expression, i->flags, target ? false : textMode, false, words);
+        for(const List<Word>::Node* j = words.getFirst(); j; j = j->getNext())
+          if(target)
+            addKey(*target, j->data);
+          else if(textMode)
+            space.addKeyRaw(j->data, 0, i->operation);
+          else if(i->value && i->operation != Token::assignment)
+            space.addKeyRaw(j->data, getCombinedValue(*i, j->data));
+          else
+            space.addKeyRaw(j->data, i->value);
+      }
+      break;
+    case removeKeyOp:
+      {
+        List<Word> words;
+        space.getKeyWords(*i->expression, 0, target ? false : textMode, true, words);
+        for(const List<Word>::Node* j = words.getFirst(); j; j = j->getNext())
+          if(target)
+            removeKey(*target, j->data);
+          else
+            space.removeKeyRaw(j->data);
+      }
+      break;
+    case referenceOp:
+      {
+        Word* word;
+        Namespace* ref;
+        if(space.engine->resolveScript(*i->string, word, ref))
+          if(ref && ref->statement)
+          {
+            ASSERT(!(ref->flags & Namespace::compilingFlag));
+            ref->flags |= Namespace::compilingFlag;
+            ref->statement->getProgram().run(space, target);
+            ref->flags &= ~Namespace::compilingFlag;
+          }
+      }
+      break;
+    case beginKeysOp:
+      lists.append();
+      break;
+    case subtractOp:
+      {
+        List<List<Word> >::Node* node = lists.getLast();
+        List<Word>* below = node->getPrevious() ? &node->getPrevious()->data : keys;
+        for(const List<Word>::Node* j = node->data.getFirst(); j; j = j->getNext())
+          if(below)
+            removeKey(*below, j->data);
+          else
+            space.removeKeyRaw(j->data);
+        lists.removeLast();
+      }
+      break;
+    case compareOp:
+      {
+        List<List<Word> >::Node* rightNode = lists.getLast();
+        List<List<Word> >::Node* leftNode = rightNode->getPrevious();
+        const List<Word>& left = leftNode->data;
+        const List<Word>& right = rightNode->data;
+        bool result = false;
+        if(i->operation == Token::equal || i->operation == Token::notEqual)
+        {
+          const List<Word>::Node* j1 = left.getFirst();
+          const List<Word>::Node* j2 = right.getFirst();
+          while(j1 && j2 && j1->data == j2->data)
+          {
+            j1 = j1->getNext();
+            j2 = j2->getNext();
+          }
+          result = !j1 && !j2;
+          if(i->operation == Token::notEqual)
+            result = !result;
+        }
+        else
+        {
+          // TODO: compare versions not numbers
+          int val = atoi(left.isEmpty() ? "" : left.getFirst()->data.getData()) - atoi(right.isEmpty() ? "" : right.getFirst()->data.getData());
+          switch(i->operation)
+          {
+          case Token::greaterThan: result = val > 0; break;
+          case Token::lowerThan: result = val < 0; break;
+          case Token::greaterEqualThan: result = val >= 0; break;
+          case Token::lowerEqualThan: result = val <= 0; break;
+          default: ASSERT(false); break;
+          }
+        }
+        lists.removeLast();
+        lists.removeLast();
+        target = lists.isEmpty() ? keys : &lists.getLast()->data;
+        if(result)
+        {
+          if(target)
+            addKey(*target, Word("true", 0));
+          else
+            space.addKeyRaw(Word("true", 0), 0);
+        }
+      }
+      break;
+    case addTrueOp:
+      if(target)
+        addKey(*target, Word("true", 0));
+      else
+        space.addKeyRaw(Word("true", 0), 0);
+      break;
+    case jumpOp:
+      i = begin + i->target - 1;
+      break;
+    case jumpIfEmptyOp:
+    case jumpIfNotEmptyOp:
+      {
+        bool empty = target->isEmpty();
+        lists.removeLast();
+        if(empty == (i->opcode == jumpIfEmptyOp))
+          i = begin + i->target - 1;
+      }
+      break;
+    }
+  }
+  ASSERT(lists.isEmpty());
+}
@@ -0,0 +1,80 @@
+
+#pragma once
+
+#include <cstddef>
+
+#include "Tools/Array.h"
+#include "Tools/List.h"
+#include "Tools/Map.h"
+#include "Tools/Word.h"
+#include "Token.h"
+
+class Namespace;
+class Statement;
+class Expression;
+
+/**
+* A statement tree lowered to a flat sequence of instructions. The keys of conditions (and of the right operand of "-") are
+* collected in temporary key lists instead of temporary namespaces.
+*/
+class Program
+{
+public:
+  enum Opcode
+  {
+    addKeyOp, /**< Adds the keys of a string (with a value) */
+    removeKeyOp, /**< Removes the keys of a string */
+    referenceOp, /**< Executes the value of a key */
+    beginKeysOp, /**< Starts collecting keys in a new temporary key list */
+    subtractOp, /**< Removes the keys of the last temporary key list from the keys below (and drops the list) */
+    compareOp, /**< Compares the last two temporary key lists (and drops them) and adds the key "true" if the comparison holds */
+    addTrueOp, /**< Adds the key "true" */
+    jumpOp, /**< Continues at another instruction */
+    jumpIfEmptyOp, /**< Drops the last temporary key list and continues at another instruction if it was empty */
+    jumpIfNotEmptyOp, /**< Drops the last temporary key list and continues at another instruction if it was not empty */
+  };
+
+  class Instruction
+  {
+  public:
+    Opcode opcode;
+    Token::Id operation; /**< The assignment operation of addKeyOp or the comparison of compareOp */
+    unsigned int flags; /**< The word flags of addKeyOp */
+    size_t target; /**< The instruction at which a jump continues */
+    const String* string; /**< The name of the key of referenceOp */
+    Expression* expression; /**< The parsed key string of addKeyOp and removeKeyOp */
+    Statement* statement; /**< The statement that was lowered to the instruction */
+    Statement* value; /**< The value of addKeyOp */
+    Map<String, Statement*>* combinedValues; /**< The values of "+=" and "-=" combined with a reference to the previous value of each key */
+
+    Instruction() : opcode(jumpOp), operation(Token::assignment), flags(0), target(0), string(0), expression(0), statement(0), value(0), combinedValues(0) {}
+  };
+
+  ~Program();
+
+  /**
+  * Appends an instruction
+  * @param opcode The opcode of the instruction
+  * @param statement The statement that is being lowered
+  * @return The instruction (which is valid until the next instruction is appended)
+  */
+  Instruction& append(Opcode opcode, Statement* statement);
+
+  /** Returns the index of the next instruction (for jumps) */
+  inline size_t getSize() const {return instructions.getSize();}
+
+  /** Sets the target of a jump instruction to the next instruction */
+  inline void setJumpTarget(size_t jump) {instructions.getFirst()[jump].target = instructions.getSize();}
+
+  /**
+  * Executes the instructions
+  * @param space The namespace in which the program is executed
+  * @param keys The key list that receives the keys instead of \c space or \c 0
+  */
+  void run(Namespace& space, List<Word>* keys) const;
+
+private:
+  Array<Instruction> instructions;
+
+  Statement* getCombinedValue(const Instruction& instruction, const Word& key) const;
+};
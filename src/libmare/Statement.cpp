@@ -1,111 +1,109 @@
 
-
 #include "Tools/Assert.h"
 #include "Statement.h"
-#include "Namespace.h"
-#include "Engine.h"
+#include "Program.h"
+#include "Expression.h"
+
+Statement::~Statement()
+{
+  delete program;
+}
+
+void Statement::execute(Namespace& space)
+{
+  getProgram().run(space, 0);
+}
+
+const Program& Statement::getProgram()
+{
+  if(!program)
+  {
+    program = new Program;
+    lower(*program);
+  }
+  return *program;
+}
 
-void BlockStatement::execute(Namespace& space)
+void BlockStatement::lower(Program& program)
 {
   for(List<Statement*>::Node* i = statements.getFirst(); i; i = i->getNext())
-    i->data->execute(space);
+    i->data->lower(program);
 }
 
-void WrapperStatement::execute(Namespace& space)
+void WrapperStatement::lower(Program& program)
 {
-  statement->execute(space);
+  statement->lower(program);
 }
 
-void AssignStatement::execute(Namespace& space)
+void AssignStatement::lower(Program& program)
 {
-  space.addKey(variable, flags, value, operation);
+  Program::Instruction& instruction = program.append(Program::addKeyOp, this);
+  instruction.expression = new Expression(variable);
+  instruction.flags = flags;
+  instruction.value = value;
+  instruction.operation = operation;
 }
 
-void RemoveStatement::execute(Namespace& space)
+void RemoveStatement::lower(Program& program)
 {
-  space.removeKey(variable);
+  program.append(Program::removeKeyOp, this).expression = new Expression(variable);
 }
 
-void BinaryStatement::execute(Namespace& space)
+void BinaryStatement::lower(Program& program)
 {
   switch(operation)
   {
   case Token::plus:
-    leftOperand->execute(space);
-    rightOperand->execute(space);
+    leftOperand->lower(program);
+    rightOperand->lower(program);
     break;
   case Token::minus:
+    leftOperand->lower(program);
+    program.append(Program::beginKeysOp, this);
+    rightOperand->lower(program);
+    program.append(Program::subtractOp, this);
+    break;
+  case Token::and_:
     {
-      leftOperand->execute(space);
-      Namespace* rightSpace = new Namespace(space.getEngine(), &space, &space.getEngine(), rightOperand, 0, 0);
-      space.removeKeysRaw(*rightSpace);
-      delete rightSpace;
+      program.append(Program::beginKeysOp, this);
+      leftOperand->lower(program);
+      size_t leftJump = program.getSize();
+      program.append(Program::jumpIfEmptyOp, this);
+      program.append(Program::beginKeysOp, this);
+      rightOperand->lower(program);
+      size_t rightJump = program.getSize();
+      program.append(Program::jumpIfEmptyOp, this);
+      program.append(Program::addTrueOp, this);
+      program.setJumpTarget(leftJump);
+      program.setJumpTarget(rightJump);
     }
     break;
-  case Token::and_:
   case Token::or_:
+    {
+      program.append(Program::beginKeysOp, this);
+      leftOperand->lower(program);
+      size_t leftJump = program.getSize();
+      program.append(Program::jumpIfNotEmptyOp, this);
+      program.append(Program::beginKeysOp, this);
+      rightOperand->lower(program);
+      size_t rightJump = program.getSize();
+      program.append(Program::jumpIfEmptyOp, this);
+      program.setJumpTarget(leftJump);
+      program.append(Program::addTrueOp, this);
+      program.setJumpTarget(rightJump);
+    }
+    break;
   case Token::equal:
   case Token::notEqual:
   case Token::greaterThan:
   case Token::lowerThan:
   case Token::greaterEqualThan:
   case Token::lowerEqualThan:
-    {
-      Namespace* leftSpace = new Namespace(space.getEngine(), &space, &space.getEngine(), leftOperand, 0, 0);
-      Namespace* rightSpace = new Namespace(space.getEngine(), &space, &space.getEngine(), rightOperand, 0, 0);
-      bool result = false;
-      switch(operation)
-      {
-      case Token::and_:
-        result = !leftSpace->getFirstKey().isEmpty() && !rightSpace->getFirstKey().isEmpty();
-        break;
-      case Token::or_:
-        result = !leftSpace->getFirstKey().isEmpty() || !rightSpace->getFirstKey().isEmpty();
-        break;
-      case Token::equal:
-        leftSpace->compareKeys(*rightSpace, result);
-        break;
-      case Token::notEqual:
-        if(leftSpace->compareKeys(*rightSpace, result))
-          result = !result;
-        break;
-      case Token::greaterThan:
-        {
-          int val;
-          if(leftSpace->versionCompareKeys(*rightSpace, val))
-            result = val > 0;
-        }
-        break;
-      case Token::lowerThan:
-        {
-          int val;
-          if(leftSpace->versionCompareKeys(*rightSpace, val))
-            result = val < 0;
-        }
-        break;
-      case Token::greaterEqualThan:
-        {
-          int val;
-          if(leftSpace->versionCompareKeys(*rightSpace, val))
-            result = val >= 0;
-        }
-        break;
-      case Token::lowerEqualThan:
-        {
-          int val;
-          if(leftSpace->versionCompareKeys(*rightSpace, val))
-            result = val <= 0;
-        }
-        break;
-      default:
-        ASSERT(false);
-        break;
-      }
-      delete leftSpace;
-      delete rightSpace;
-      if(result)
-        space.addKeyRaw(Word("true", 0), 0);
-    }
+    program.append(Program::beginKeysOp, this);
+    leftOperand->lower(program);
+    program.append(Program::beginKeysOp, this);
+    rightOperand->lower(program);
+    program.append(Program::compareOp, this).operation = operation;
     break;
 
   default:
@@ -114,47 +112,47 @@ void BinaryStatement::execute(Namespace& space)
   }
 }
 
-void StringStatement::execute(Namespace& space)
+void StringStatement::lower(Program& program)
 {
-  space.addKey(value, 0, 0);
+  program.append(Program::addKeyOp, this).expression = new Expression(value);
 }
 
-void ReferenceStatement::execute(Namespace& space)
+void ReferenceStatement::lower(Program& program)
 {
-  Word* word;
-  Namespace* ref;
-  if(space.getEngine().resolveScript(variable, word, ref))
-    if(ref && ref->statement)
-    {
-      ASSERT(!(ref->flags & Namespace::compilingFlag));
-      ref->flags |= Namespace::compilingFlag;
-      ref->statement->execute(space);
-      ref->flags &= ~Namespace::compilingFlag;
-    }
+  program.append(Program::referenceOp, this).string = &variable;
 }
 
-void IfStatement::execute(Namespace& space)
+void IfStatement::lower(Program& program)
 {
-  Namespace* condSpace = new Namespace(space.getEngine(), &space, &space.getEngine(), condition, 0, 0);
-  bool cond = !condSpace->getFirstKey().isEmpty();
-  delete condSpace;
-  if(cond)
-    thenStatements->execute(space);
-  else if(elseStatements)
-    elseStatements->execute(space);
+  program.append(Program::beginKeysOp, this);
+  condition->lower(program);
+  size_t conditionJump = program.getSize();
+  program.append(Program::jumpIfEmptyOp, this);
+  thenStatements->lower(program);
+  if(elseStatements)
+  {
+    size_t thenJump = program.getSize();
+    program.append(Program::jumpOp, this);
+    program.setJumpTarget(conditionJump);
+    elseStatements->lower(program);
+    program.setJumpTarget(thenJump);
+  }
+  else
+    program.setJumpTarget(conditionJump);
 }
 
-void UnaryStatement::execute(Namespace& space)
+void UnaryStatement::lower(Program& program)
 {
   switch(operation)
   {
   case Token::not_:
     {
-      Namespace* opSpace = new Namespace(space.getEngine(), &space, &space.getEngine(), operand, 0, 0);
-      bool result = opSpace->getFirstKey().isEmpty();
-      delete opSpace;
-      if(result)
-        space.addKeyRaw(Word("true", 0), 0);
+      program.append(Program::beginKeysOp, this);
+      operand->lower(program);
+      size_t jump = program.getSize();
+      program.append(Program::jumpIfNotEmptyOp, this);
+      program.append(Program::addTrueOp, this);
+      program.setJumpTarget(jump);
     }
     break;
   default:
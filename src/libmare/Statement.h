@@ -7,13 +7,26 @@
 #include "Token.h"
 
 class Namespace;
+class Program;
 
 class Statement : public Scope::Object
 {
 public:
-  Statement(Scope& scope) : Scope::Object(scope) {}
+  Statement(Scope& scope) : Scope::Object(scope), program(0) {}
 
-  virtual void execute(Namespace& space) = 0;
+  virtual ~Statement();
+
+  /** Executes the statement in a namespace */
+  void execute(Namespace& space);
+
+  /** Returns the statement lowered to a program (which is created when it is used for the first time) */
+  const Program& getProgram();
+
+  /** Appends the instructions of the statement to a program */
+  virtual void lower(Program& program) = 0;
+
+private:
+  Program* program;
 };
 
 class BlockStatement : public Statement
@@ -24,7 +37,7 @@ public:
   BlockStatement(Scope& scope) : Statement(scope) {}
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
 
 class WrapperStatement : public Statement
@@ -35,7 +48,7 @@ public:
   WrapperStatement(Scope& scope) : Statement(scope), statement(0) {}
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
 
 class AssignStatement : public Statement
@@ -49,7 +62,7 @@ public:
   Statement* value;
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
 
 class RemoveStatement : public Statement
@@ -60,7 +73,7 @@ public:
   String variable;
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
 
 class BinaryStatement : public Statement
@@ -73,7 +86,7 @@ public:
   Statement* rightOperand;
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
 
 class UnaryStatement : public Statement
@@ -85,7 +98,7 @@ public:
   Statement* operand;
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
 
 class StringStatement : public Statement
@@ -96,7 +109,7 @@ public:
   String value;
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
 
 class ReferenceStatement : public Statement
@@ -107,7 +120,7 @@ public:
   String variable;
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
 
 /** "if ... then ... else ..." and " ... ? ... : ..." */
@@ -121,5 +134,5 @@ public:
   Statement* elseStatements;
 
 private:
-  virtual void execute(Namespace& space);
+  virtual void lower(Program& program);
 };
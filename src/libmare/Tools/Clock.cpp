@@ -0,0 +1,24 @@
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "Clock.h"
+
+long long Clock::getMicroseconds()
+{
+#ifdef _WIN32
+  static LARGE_INTEGER frequency = {0};
+  if(!frequency.QuadPart)
+    QueryPerformanceFrequency(&frequency);
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart / frequency.QuadPart * 1000000LL + counter.QuadPart % frequency.QuadPart * 1000000LL / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((long long)ts.tv_sec) * 1000000LL + ((long long)ts.tv_nsec) / 1000LL;
+#endif
+}
@@ -0,0 +1,12 @@
+
+#pragma once
+
+class Clock
+{
+public:
+  /**
+  * Returns the value of a monotonic clock
+  * @return The time in microseconds since an unspecified starting point
+  */
+  static long long getMicroseconds();
+};
@@ -191,7 +191,7 @@ bool Directory::read(String& name, bool& isDir)
 #endif
 }
 
-void Directory::findFiles(const String& pattern, List<String>& files)
+void Directory::findFiles(const String& pattern, List<String>& files, List<String>* dirs)
 {
   // replace ** with * / ** and split in chunks
   List<String> chunks;
@@ -213,6 +213,7 @@ void Directory::findFiles(const String& pattern, List<String>& files)
   struct FindFiles
   {
     List<String>* files;
+    List<String>* dirs;
     bool dirsOnly;
 
     void handlePath(const String& path, const String& pattern, const List<String>::Node* nextChunk)
@@ -300,6 +301,8 @@ void Directory::findFiles(const String& pattern, List<String>& files)
     void handlePath2(const String& path, const String& pattern, const String& nextPattern, const List<String>::Node* nextNextChunk)
     {
       Directory dir; String name; bool isDir;
+      if(dirs)
+        dirs->append(path.isEmpty() ? String(".") : path);
       if(dir.open(path, pattern, !nextPattern.isEmpty() || dirsOnly))
         while(dir.read(name, isDir))
           handleSubPath(path, name, isDir, nextPattern, nextNextChunk);
@@ -336,6 +339,7 @@ void Directory::findFiles(const String& pattern, List<String>& files)
     char lastChar = pattern.getData()[pattern.getLength() - 1];
     ff.dirsOnly = lastChar == '/' || lastChar == '\\';
     ff.files = &files;
+    ff.dirs = dirs;
     ff.handlePath(String(), chunks.getFirst()->data, chunks.getFirst()->getNext());
   }
 }
@@ -37,7 +37,13 @@ public:
   */
   bool read(String& path, bool& isDir);
 
-  static void findFiles(const String& pattern, List<String>& files);
+  /**
+  * Searches files that match a pattern with wildcards (including "**" for any number of subdirectories)
+  * @param pattern The pattern
+  * @param files Receives the matching files
+  * @param dirs Receives the directories that were searched (or tried to search) for the files if not \c 0
+  */
+  static void findFiles(const String& pattern, List<String>& files, List<String>* dirs = 0);
 
   static bool exists(const String& dir);
 
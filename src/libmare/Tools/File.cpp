@@ -9,11 +9,80 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <utime.h>
+#include <pthread.h>
 #endif
 
 #include "Assert.h"
 #include "File.h"
 #include "String.h"
+#include "Map.h"
+#include "Array.h"
+
+/** A cached result of File::getStatus() */
+class CachedStatus
+{
+public:
+  const char* path; /**< The path used while the status is prefetched */
+  bool exists;
+  bool isNew; /**< Whether the file was not yet reported by File::getNewCachedFiles() */
+  File::Status status;
+};
+
+static Map<String, CachedStatus>* statusCache = 0;
+static unsigned int statusCacheUsers = 0;
+
+static bool readStatus(const char* file, File::Status& status)
+{
+#ifdef _WIN32
+  WIN32_FIND_DATAA wfd;
+  HANDLE hFind = FindFirstFileA(file, &wfd);
+  if(hFind == INVALID_HANDLE_VALUE)
+    return false;
+  status.writeTime = ((long long)wfd.ftLastWriteTime.dwHighDateTime) << 32LL | ((long long)wfd.ftLastWriteTime.dwLowDateTime);
+  status.size = ((long long)wfd.nFileSizeHigh) << 32LL | ((long long)wfd.nFileSizeLow);
+  status.id = 0;
+  FindClose(hFind);
+  return true;
+#else
+  struct stat buf;
+  if(stat(file, &buf) != 0)
+    return false;
+  status.writeTime = ((long long)buf.st_mtim.tv_sec) * 1000000000LL + ((long long)buf.st_mtim.tv_nsec);
+  status.size = (long long)buf.st_size;
+  status.id = (unsigned long long)buf.st_ino;
+  return true;
+#endif
+}
+
+/** A thread that reads the status of every n-th file of a list of files */
+class StatusPrefetcher
+{
+public:
+  CachedStatus** statuses;
+  size_t count;
+  size_t step;
+
+  void run()
+  {
+    for(CachedStatus** i = statuses, ** end = statuses + count; i < end; i += step)
+      (*i)->exists = readStatus((*i)->path, (*i)->status);
+  }
+
+#ifdef _WIN32
+  static DWORD WINAPI threadProc(LPVOID param)
+  {
+    ((StatusPrefetcher*)param)->run();
+    return 0;
+  }
+#else
+  static void* threadProc(void* param)
+  {
+    ((StatusPrefetcher*)param)->run();
+    return 0;
+  }
+#endif
+};
 
 File::File()
 {
@@ -47,6 +116,15 @@ void File::close()
 #endif
 }
 
+bool File::isOpen() const
+{
+#ifdef _WIN32
+  return fp != INVALID_HANDLE_VALUE;
+#else
+  return fp != 0;
+#endif
+}
+
 bool File::unlink(const String& file)
 {
 #ifdef _WIN32
@@ -59,6 +137,64 @@ bool File::unlink(const String& file)
   return true;
 }
 
+bool File::rename(const String& from, const String& to)
+{
+#ifdef _WIN32
+  if(!MoveFileEx(from.getData(), to.getData(), MOVEFILE_REPLACE_EXISTING))
+    return false;
+#else
+  if(::rename(from.getData(), to.getData()) != 0)
+    return false;
+#endif
+  return true;
+}
+
+bool File::touch(const String& file)
+{
+#ifdef _WIN32
+  HANDLE hFile = CreateFile(file.getData(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(hFile == INVALID_HANDLE_VALUE)
+    return false;
+  FILETIME fileTime;
+  GetSystemTimeAsFileTime(&fileTime);
+  BOOL result = SetFileTime(hFile, NULL, NULL, &fileTime);
+  CloseHandle(hFile);
+  if(!result)
+    return false;
+#else
+  if(utime(file.getData(), 0) != 0)
+    return false;
+#endif
+  return true;
+}
+
+bool File::getPermissions(const String& file, unsigned int& permissions)
+{
+#ifdef _WIN32
+  if(GetFileAttributes(file.getData()) == INVALID_FILE_ATTRIBUTES)
+    return false;
+  permissions = 0;
+#else
+  struct stat buf;
+  if(stat(file.getData(), &buf) != 0)
+    return false;
+  permissions = (unsigned int)(buf.st_mode & 07777);
+#endif
+  return true;
+}
+
+bool File::setPermissions(const String& file, unsigned int permissions)
+{
+#ifdef _WIN32
+  if(GetFileAttributes(file.getData()) == INVALID_FILE_ATTRIBUTES)
+    return false;
+#else
+  if(permissions && chmod(file.getData(), (mode_t)permissions) != 0)
+    return false;
+#endif
+  return true;
+}
+
 bool File::open(const String& file, Flags flags)
 {
 #ifdef _WIN32
@@ -68,7 +204,12 @@ bool File::open(const String& file, Flags flags)
     return false;
   }
   DWORD desiredAccess = 0, creationDisposition = 0;
-  if(flags & writeFlag)
+  if(flags & appendFlag)
+  {
+    desiredAccess |= GENERIC_WRITE;
+    creationDisposition |= OPEN_ALWAYS;
+  }
+  else if(flags & writeFlag)
   {
     desiredAccess |= GENERIC_WRITE;
     creationDisposition |= CREATE_ALWAYS;
@@ -76,7 +217,7 @@ bool File::open(const String& file, Flags flags)
   if(flags & readFlag)
   {
     desiredAccess |= GENERIC_READ;
-    if(!(flags & writeFlag))
+    if(!(flags & (writeFlag | appendFlag)))
       creationDisposition |= OPEN_EXISTING;
   }
   fp = CreateFileA(file.getData(), desiredAccess, FILE_SHARE_READ, NULL, creationDisposition, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -118,10 +259,12 @@ bool File::open(const String& file, Flags flags)
       else
           return false;
   }
+  if(flags & appendFlag)
+    SetFilePointer((HANDLE)fp, 0, NULL, FILE_END);
 #else
   if(fp)
     return false;
-  const char* mode = (flags & (writeFlag | readFlag)) == (writeFlag | readFlag) ? "w+" : (flags & writeFlag ? "w" : "r");
+  const char* mode = flags & appendFlag ? "a" : ((flags & (writeFlag | readFlag)) == (writeFlag | readFlag) ? "w+" : (flags & writeFlag ? "w" : "r"));
   fp = fopen(file.getData(), mode);
   if(!fp)
     return false;
@@ -295,6 +438,14 @@ bool File::isPathAbsolute(const String& path)
 
 bool File::getWriteTime(const String& file, long long& writeTime)
 {
+  if(statusCache)
+  {
+    Status status;
+    if(!getStatus(file, status))
+      return false;
+    writeTime = status.writeTime;
+    return true;
+  }
 #ifdef _WIN32
   WIN32_FIND_DATAA wfd;
   HANDLE hFind = FindFirstFileA(file.getData(), &wfd);
@@ -313,8 +464,122 @@ bool File::getWriteTime(const String& file, long long& writeTime)
 #endif
 }
 
+bool File::getStatus(const String& file, Status& status)
+{
+  if(!statusCache)
+    return readStatus(file.getData(), status);
+  String key = simplifyPath(file);
+  Map<String, CachedStatus>::Node* node = statusCache->find(key);
+  if(!node)
+  {
+    CachedStatus& cachedStatus = statusCache->append(key);
+    cachedStatus.path = 0;
+    cachedStatus.isNew = true;
+    cachedStatus.exists = readStatus(file.getData(), cachedStatus.status);
+    node = statusCache->getLast();
+  }
+  if(!node->data.exists)
+    return false;
+  status = node->data.status;
+  return true;
+}
+
+void File::enableStatusCache(bool enable)
+{
+  if(enable)
+  {
+    if(statusCacheUsers++ == 0)
+      statusCache = new Map<String, CachedStatus>;
+  }
+  else if(statusCacheUsers > 0 && --statusCacheUsers == 0)
+  {
+    delete statusCache;
+    statusCache = 0;
+  }
+}
+
+void File::invalidateStatus(const String& file)
+{
+  if(!statusCache)
+    return;
+  Map<String, CachedStatus>::Node* node = statusCache->find(simplifyPath(file));
+  if(node)
+    statusCache->remove(node);
+}
+
+void File::prefetchStatus(const List<String>& files)
+{
+  if(!statusCache)
+    return;
+
+  // collect files with unknown status
+  Array<CachedStatus*> pending;
+  for(const List<String>::Node* i = files.getFirst(); i; i = i->getNext())
+  {
+    String key = simplifyPath(i->data);
+    if(statusCache->find(key))
+      continue;
+    CachedStatus& cachedStatus = statusCache->append(key);
+    cachedStatus.path = statusCache->getLast()->key.getData();
+    cachedStatus.isNew = true;
+    pending.append(&cachedStatus);
+  }
+
+  // read the status of the files using multiple threads
+  size_t threadCount = (pending.getSize() + 255) / 256;
+  if(threadCount > 8)
+    threadCount = 8;
+  StatusPrefetcher prefetchers[8];
+  for(size_t i = 0; i < threadCount || i == 0; ++i)
+  {
+    prefetchers[i].statuses = pending.getFirst() + i;
+    prefetchers[i].count = i < pending.getSize() ? pending.getSize() - i : 0;
+    prefetchers[i].step = threadCount ? threadCount : 1;
+  }
+#ifdef _WIN32
+  HANDLE threads[8];
+  for(size_t i = 1; i < threadCount; ++i)
+    if(!(threads[i] = CreateThread(NULL, 0, StatusPrefetcher::threadProc, &prefetchers[i], 0, NULL)))
+      prefetchers[i].run();
+  prefetchers[0].run();
+  for(size_t i = 1; i < threadCount; ++i)
+    if(threads[i])
+    {
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+    }
+#else
+  pthread_t threads[8];
+  bool started[8];
+  for(size_t i = 1; i < threadCount; ++i)
+    if(!(started[i] = pthread_create(&threads[i], 0, StatusPrefetcher::threadProc, &prefetchers[i]) == 0))
+      prefetchers[i].run();
+  prefetchers[0].run();
+  for(size_t i = 1; i < threadCount; ++i)
+    if(started[i])
+      pthread_join(threads[i], 0);
+#endif
+}
+
+void File::getNewCachedFiles(List<String>& files)
+{
+  if(!statusCache)
+    return;
+  for(Map<String, CachedStatus>::Node* i = statusCache->getFirst(); i; i = i->getNext())
+    if(i->data.isNew)
+    {
+      files.append(i->key);
+      i->data.isNew = false;
+    }
+}
+
 bool File::exists(const String& file)
 {
+  if(statusCache)
+  {
+    Status status;
+    return getStatus(file, status);
+  }
 #ifdef _WIN32
   WIN32_FIND_DATAA wfd;
   HANDLE hFind = FindFirstFileA(file.getData(), &wfd);
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "String.h"
+#include "List.h"
 
 class File
 {
@@ -10,6 +11,15 @@ public:
   {
     readFlag = 0x0001,
     writeFlag = 0x0002,
+    appendFlag = 0x0004,
+  };
+
+  class Status
+  {
+  public:
+    long long writeTime;
+    long long size;
+    unsigned long long id; /**< The inode number of the file (or \c 0 if the file system does not provide one) */
   };
 
   File();
@@ -17,6 +27,7 @@ public:
 
   bool open(const String& file, Flags flags = readFlag);
   void close();
+  bool isOpen() const;
   size_t read(char* buffer, size_t len);
   size_t write(const char* buffer, size_t len);
   bool write(const String& data);
@@ -30,9 +41,46 @@ public:
   static bool isPathAbsolute(const String& path);
 
   static bool getWriteTime(const String& file, long long& writeTime);
+  static bool getStatus(const String& file, Status& status);
+
+  /**
+  * Enables or disables a process-wide cache for the results of getWriteTime(), getStatus() and exists(). While the cache is
+  * enabled, files that are modified by the process have to be reported using invalidateStatus().
+  * @param enable Whether to enable the cache. The cached results are discarded when the cache has been disabled as often as it has been enabled.
+  */
+  static void enableStatusCache(bool enable);
+
+  /**
+  * Removes the status of a file from the status cache
+  * @param file The path to the file
+  */
+  static void invalidateStatus(const String& file);
+
+  /**
+  * Reads the status of multiple files in parallel and adds it to the status cache
+  * @param files The paths to the files
+  */
+  static void prefetchStatus(const List<String>& files);
+
+  /**
+  * Returns the files whose status was added to the status cache since the last call
+  * @param files The list to which the paths of the files are added
+  */
+  static void getNewCachedFiles(List<String>& files);
 
   static bool exists(const String& file);
   static bool unlink(const String& file);
+  static bool rename(const String& from, const String& to);
+  static bool touch(const String& file);
+
+  /**
+  * Reads the access permissions of a file
+  * @param file The path to the file
+  * @param permissions The permission bits (or \c 0 if the file system does not support them)
+  * @return Whether the permissions could be read
+  */
+  static bool getPermissions(const String& file, unsigned int& permissions);
+  static bool setPermissions(const String& file, unsigned int permissions);
 
 private:
   void* fp;
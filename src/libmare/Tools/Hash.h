@@ -0,0 +1,31 @@
+
+#pragma once
+
+#include "String.h"
+
+/** A 64-bit FNV-1a hash */
+class Hash
+{
+public:
+  Hash() : value(14695981039346656037ULL) {}
+
+  Hash& append(const void* data, size_t length)
+  {
+    unsigned long long value = this->value;
+    for(const unsigned char* pos = (const unsigned char*)data, * end = pos + length; pos < end; ++pos)
+    {
+      value ^= *pos;
+      value *= 1099511628211ULL;
+    }
+    this->value = value;
+    return *this;
+  }
+
+  inline Hash& append(const String& str) {return append(str.getData(), str.getLength() + 1);}
+  inline Hash& append(long long data) {return append(&data, sizeof(data));}
+
+  inline unsigned long long get() const {return value;}
+
+private:
+  unsigned long long value;
+};
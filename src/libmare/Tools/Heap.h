@@ -0,0 +1,68 @@
+
+#pragma once
+
+#include "Array.h"
+
+/** A priority queue (binary max-heap) that returns elements with equal priorities in insertion order */
+template <typename T> class Heap
+{
+public:
+  Heap() : count(0) {}
+
+  void append(long long priority, const T& data)
+  {
+    size_t index = nodes.getSize();
+    nodes.append();
+    Node* nodes = this->nodes.getFirst();
+    Node node;
+    node.priority = priority;
+    node.order = count++;
+    node.data = data;
+    for(size_t parent; index > 0 && isHigher(node, nodes[parent = (index - 1) / 2]); index = parent)
+      nodes[index] = nodes[parent];
+    nodes[index] = node;
+  }
+
+  T removeFirst()
+  {
+    Node* nodes = this->nodes.getFirst();
+    T result = nodes[0].data;
+    size_t size = this->nodes.getSize() - 1;
+    Node node = nodes[size];
+    size_t index = 0;
+    for(size_t child; (child = index * 2 + 1) < size; index = child)
+    {
+      if(child + 1 < size && isHigher(nodes[child + 1], nodes[child]))
+        ++child;
+      if(!isHigher(nodes[child], node))
+        break;
+      nodes[index] = nodes[child];
+    }
+    nodes[index] = node;
+    this->nodes.setSize(size);
+    return result;
+  }
+
+  inline const T& getFirst() const {return nodes.getFirst()->data;}
+  inline long long getFirstPriority() const {return nodes.getFirst()->priority;}
+
+  inline size_t getSize() const {return nodes.getSize();}
+  inline bool isEmpty() const {return nodes.isEmpty();}
+
+private:
+  class Node
+  {
+  public:
+    long long priority;
+    unsigned int order;
+    T data;
+  };
+
+  Array<Node> nodes;
+  unsigned int count;
+
+  static bool isHigher(const Node& a, const Node& b)
+  {
+    return a.priority > b.priority || (a.priority == b.priority && a.order < b.order);
+  }
+};
@@ -1,6 +1,27 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstring>
+
+/** Hash functions for the key types of maps (other key types provide a \c hashKey function next to their class) */
+inline size_t hashKey(unsigned long long key)
+{
+  // mix all bits into the low bits that select the slot in the index (like the finalizer of MurmurHash3), since
+  // pointers to objects of the same size or with a larger alignment would otherwise form long probing sequences
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (size_t)key;
+}
+inline size_t hashKey(int key) {return hashKey((unsigned long long)(unsigned int)key);}
+inline size_t hashKey(unsigned int key) {return hashKey((unsigned long long)key);}
+template <typename T> inline size_t hashKey(T* key) {return hashKey((unsigned long long)(size_t)key);}
+
+/**
+* A map that keeps its nodes in insertion order. Maps with more than a few nodes are indexed with an open addressing
+* hash table for \c find and \c lookup.
+*/
 template <typename K, typename T> class Map
 {
 public:
@@ -20,11 +41,12 @@ public:
   private:
     Node* next;
     Node* previous;
+    size_t hash;
 
     friend class Map;
   };
 
-  Map() : first(0), last(0), size(0), firstFree(0) {}
+  Map() : first(0), last(0), size(0), firstFree(0), index(0), indexCapacity(0) {}
 
   ~Map()
   {
@@ -34,6 +56,7 @@ public:
       next = node->next;
       delete node;
     }
+    delete[] index;
   }
 
   Map& operator=(const Map& other)
@@ -63,11 +86,23 @@ public:
       first = node;
     last = node;
     ++size;
+    if(index)
+    {
+      node->hash = hashKey(node->key);
+      if(size * 4 > indexCapacity * 3)
+        rebuildIndex(indexCapacity * 2);
+      else
+        insertIndex(node);
+    }
+    else if(size > maxUnindexedSize)
+      rebuildIndex(maxUnindexedSize * 4);
     return node->data;
   }
 
   void remove(Node* node)
   {
+    if(index)
+      removeIndex(node);
     if(node->next)
       node->next->previous = node->previous;
     else
@@ -89,34 +124,40 @@ public:
       firstFree = first;
       first = last = 0;
       size = 0;
+      if(index)
+        memset(index, 0, sizeof(Node*) * indexCapacity);
     }
   }
 
   Node* find(const K& key)
   {
-    // TODO: use hash map
-    for(Node* node = first; node; node = node->next)
-      if(node->key == key)
-        return node;
-    return 0;
+    return (Node*)((const Map*)this)->find(key);
   }
 
   const Node* find(const K& key) const
   {
-    // TODO: use hash map
-    for(const Node* node = first; node; node = node->next)
-      if(node->key == key)
+    if(!index)
+    {
+      for(const Node* node = first; node; node = node->next)
+        if(node->key == key)
+          return node;
+      return 0;
+    }
+    size_t hash = hashKey(key);
+    for(size_t mask = indexCapacity - 1, i = hash & mask;; i = (i + 1) & mask)
+    {
+      const Node* node = index[i];
+      if(!node)
+        return 0;
+      if(node->hash == hash && node->key == key)
         return node;
-    return 0;
+    }
   }
 
   T lookup(const K& key) const
   {
-    // TODO: use hash map
-    for(Node* node = first; node; node = node->next)
-      if(node->key == key)
-        return node->data;
-    return T();
+    const Node* node = find(key);
+    return node ? node->data : T();
   }
 
   inline Node* getFirst() {return first;}
@@ -129,9 +170,61 @@ public:
   inline bool isEmpty() const {return first == 0;}
 
 private:
+  enum
+  {
+    maxUnindexedSize = 8, /**< The size up to which the nodes are searched without an index */
+  };
+
   Node* first;
   Node* last;
   unsigned int size;
   Node* firstFree;
-};
+  Node** index; /**< The nodes by hash (with linear probing) or \c 0 if the map was never larger than \c maxUnindexedSize */
+  size_t indexCapacity; /**< The size of \c index (a power of two) */
 
+  void rebuildIndex(size_t capacity)
+  {
+    bool hashed = index != 0;
+    delete[] index;
+    index = new Node*[capacity];
+    indexCapacity = capacity;
+    memset(index, 0, sizeof(Node*) * capacity);
+    for(Node* node = first; node; node = node->next)
+    {
+      if(!hashed)
+        node->hash = hashKey(node->key);
+      insertIndex(node);
+    }
+  }
+
+  void insertIndex(Node* node)
+  {
+    size_t mask = indexCapacity - 1, i = node->hash & mask;
+    while(index[i])
+      i = (i + 1) & mask;
+    index[i] = node;
+  }
+
+  void removeIndex(Node* node)
+  {
+    size_t mask = indexCapacity - 1, i = node->hash & mask;
+    while(index[i] != node)
+      i = (i + 1) & mask;
+
+    // move following nodes of the probing sequence into the gap
+    for(size_t j = i;;)
+    {
+      j = (j + 1) & mask;
+      Node* next = index[j];
+      if(!next)
+        break;
+      size_t home = next->hash & mask;
+      if(i <= j ? (home <= i || home > j) : (home <= i && home > j))
+      {
+        index[i] = next;
+        i = j;
+      }
+    }
+    index[i] = 0;
+  }
+};
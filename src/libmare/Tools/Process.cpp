@@ -2,15 +2,30 @@
 #include <malloc.h>
 #ifdef _WIN32
 #include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
 #else
 #include <unistd.h>
 #include <cerrno>
 #include <cstdlib>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <csignal>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <fcntl.h>
 #include <cstdio>
 #include <cstring>
 #include <sys/utsname.h> // uname
+#ifdef __linux
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#else
+#include <poll.h>
+#endif
 #endif
 
 #include "Assert.h"
@@ -22,15 +37,50 @@
 #include "Array.h"
 #else
 #include "Error.h"
+#include "Clock.h"
 #endif
 
 #ifdef _WIN32
 static Array<HANDLE> runningProcessHandles;
 #else
 static Map<pid_t, Process*> runningProcesses;
+static sigset_t forwardedSignals; /**< The signals that are forwarded to the process groups of the running processes */
+#ifdef __linux
+static int epollFd = -1; /**< An epoll instance that watches the output pipes and pidfds of the running processes */
+#endif
+#endif
+
+#ifndef _WIN32
+/** Forwards a signal to the running processes (which do not receive signals from the terminal in their own process groups) and terminates */
+static void forwardSignal(int signal)
+{
+  for(const Map<pid_t, Process*>::Node* i = runningProcesses.getFirst(); i; i = i->getNext())
+    ::kill(-i->key, signal);
+  ::signal(signal, SIG_DFL);
+  raise(signal);
+}
+
+/** Installs the handlers that forward signals to the running processes unless the signals are ignored or handled otherwise */
+static void installSignalForwarding()
+{
+  static const int signals[] = {SIGINT, SIGTERM, SIGHUP};
+  sigemptyset(&forwardedSignals);
+  for(size_t i = 0; i < sizeof(signals) / sizeof(*signals); ++i)
+  {
+    struct sigaction action;
+    if(sigaction(signals[i], 0, &action) == 0 && action.sa_handler == SIG_DFL)
+    {
+      sigemptyset(&action.sa_mask);
+      action.sa_flags = SA_RESTART;
+      action.sa_handler = forwardSignal;
+      sigaction(signals[i], &action, 0);
+    }
+    sigaddset(&forwardedSignals, signals[i]);
+  }
+}
 #endif
 
-Process::Process()
+Process::Process() : peakMemory(0), cpuTime(0)
 {
 #ifdef _WIN32
   ASSERT(sizeof(hProcess) >= sizeof(HANDLE));
@@ -38,6 +88,8 @@ Process::Process()
 #else
   pid = 0;
   exitCode = 1;
+  outputFd = -1;
+  pidFd = -1;
 #endif
 }
 
@@ -55,6 +107,10 @@ Process::~Process()
   }
 #else
   ASSERT(pid ==  0);
+  if(outputFd != -1)
+    close(outputFd);
+  if(pidFd != -1)
+    close(pidFd);
 #endif
 }
 
@@ -67,172 +123,298 @@ bool Process::isRunning() const
 #endif
 }
 
-unsigned int Process::start(const String& rawCommandLine)
+#ifdef _WIN32
+struct Executable
 {
-  // split commands into words
-  List<Word> command;
-  Word::split(rawCommandLine, command);
-
-  // separate leading environment variables and the command line
-  Map<String, String> environmentVariables;
-  for(List<Word>::Node* envNode = command.getFirst(); envNode; envNode = command.getFirst())
+  static bool fileComplete(const String& searchName, bool testExtensions, String& result)
   {
-    const char* data = envNode->data.getData();
-    const char* sep = strchr(data, '=');
-    if(sep)
+    if(File::exists(searchName))
     {
-      // load list of existing existing variables
-      if(environmentVariables.isEmpty())
+      result = searchName;
+      return true;
+    }
+    if(testExtensions)
+    {
+      String testPath = searchName;
+      testPath.append(".exe");
+      if(File::exists(testPath))
       {
-        const Map<String, String>& envs = getEnvironmentVariables();
-        for(const Map<String, String>::Node* i = envs.getFirst(); i; i = i->getNext())
-          environmentVariables.append(i->key, i->data);
+        result = testPath;
+        return true;
+      }
+      testPath.setLength(searchName.getLength());
+      testPath.append(".com");
+      if(File::exists(testPath))
+      {
+        result = testPath;
+        return true;
       }
-
-      // add or override a variable
-      String key(data, sep - data);
-      Map<String, String>::Node* existingNode = environmentVariables.find(key);
-      if(existingNode)
-        existingNode->data = envNode->data;
-      else
-        environmentVariables.append(key, envNode->data);
-
-      //
-      command.removeFirst();
     }
-    else
-      break;
+    return false;
   }
 
-#ifdef _WIN32
-  struct Executable
+  static const List<String>& getPathEnv()
   {
-    static bool fileComplete(const String& searchName, bool testExtensions, String& result)
+    static List<String> searchPaths;
+    static bool loaded = false;
+    if(!loaded)
     {
-      if(File::exists(searchName))
-      {
-        result = searchName;
-        return true;
-      }
-      if(testExtensions)
+      char* pathVar = (char*)alloca(32767);
+      GetEnvironmentVariable("PATH", pathVar, 32767);
+      for(const char* str = pathVar; *str;)
       {
-        String testPath = searchName;
-        testPath.append(".exe");
-        if(File::exists(testPath))
+        const char* end = strchr(str, ';');
+        if(end)
         {
-          result = testPath;
-          return true;
+          if(end > str)
+            searchPaths.append(String(str, end - str));
+          ++end;
+          str = end;
         }
-        testPath.setLength(searchName.getLength());
-        testPath.append(".com");
-        if(File::exists(testPath))
+        else
         {
-          result = testPath;
-          return true;
+          searchPaths.append(String(str, -1));
+          break;
         }
       }
-      return false;
+      loaded = true;
     }
+    return searchPaths;
+  }
 
-    static const List<String>& getPathEnv()
+  static bool resolveSymlink(const String& fileName, String& result)
+  {
+    String cygwinRoot = File::getDirname(File::getDirname(fileName));
+    result = fileName;
+    bool success = false;
+    for(;;)
     {
-      static List<String> searchPaths;
-      static bool loaded = false;
-      if(!loaded)
+      File file;
+      if(!file.open(result))
+        return success;
+      const int len = 12 + MAX_PATH * 2 + 2;
+      char buffer[len];
+      size_t i = file.read(buffer, len);
+      if(i < 12 || strncmp(buffer, "!<symlink>\xff\xfe", 12) != 0)
+        return success;
+      i &= ~1;
+      wchar_t* wdest = (wchar_t*)(buffer + 12);
+      wdest[(i - 12) >> 1] = 0;
+      String dest;
+      dest.format(i - 12, "%S", wdest);
+      if(strncmp(dest.getData(), "/usr/bin/", 9) == 0)
       {
-        char* pathVar = (char*)alloca(32767);
-        GetEnvironmentVariable("PATH", pathVar, 32767);
-        for(const char* str = pathVar; *str;)
-        {
-          const char* end = strchr(str, ';');
-          if(end)
-          {
-            if(end > str)
-              searchPaths.append(String(str, end - str));
-            ++end;
-            str = end;
-          }
-          else
-          {
-            searchPaths.append(String(str, -1));
-            break;
-          }
-        }
-        loaded = true;
+        result = cygwinRoot;
+        result.append(dest.substr(4));
       }
-      return searchPaths;
+      else if(dest.getData()[0] == '/')
+      {
+        result = cygwinRoot;
+        result.append(dest);
+      }
+      else
+      {
+        result = File::getDirname(result);
+        result.append('/');
+        result.append(dest);
+      }
+      success = true;
     }
+    return false;
+  }
 
-    static bool resolveSymlink(const String& fileName, String& result)
-    {
-      String cygwinRoot = File::getDirname(File::getDirname(fileName));
-      result = fileName;
-      bool success = false;
-      for(;;)
+  static String find(const String& program)
+  {
+    String result = program;
+    bool testExtensions = File::getExtension(program).isEmpty();
+    // check whether the given path is absolute
+    if(program.getData()[0] == '/' || (program.getLength() > 2 && program.getData()[1] == ':'))
+    { // absolute
+      fileComplete(program, testExtensions, result);
+    }
+    else
+    { // try each search path
+      const List<String>& searchPaths = getPathEnv();
+      for(const List<String>::Node* i = searchPaths.getFirst(); i; i = i->getNext())
       {
-        File file;
-        if(!file.open(result))
-          return success;
-        const int len = 12 + MAX_PATH * 2 + 2;
-        char buffer[len];
-        size_t i = file.read(buffer, len);
-        if(i < 12 || strncmp(buffer, "!<symlink>\xff\xfe", 12) != 0)
-          return success;
-        i &= ~1;
-        wchar_t* wdest = (wchar_t*)(buffer + 12);
-        wdest[(i - 12) >> 1] = 0;
-        String dest;
-        dest.format(i - 12, "%S", wdest);
-        if(strncmp(dest.getData(), "/usr/bin/", 9) == 0)
+        String testPath = i->data;
+        testPath.append('\\');
+        testPath.append(program);
+        if(fileComplete(testPath, testExtensions, result))
         {
-          result = cygwinRoot;
-          result.append(dest.substr(4));
+          if(strncmp(program.getData(), "../", 3) == 0 || strncmp(program.getData(), "..\\", 3) == 0)
+            result = File::simplifyPath(result);
+          break;
         }
-        else if(dest.getData()[0] == '/')
+      }
+    }
+    return result;
+  }
+};
+#else
+struct Executable
+{
+  static const List<String>& getPathEnv()
+  {
+    static List<String> searchPaths;
+    static bool loaded = false;
+    if(!loaded)
+    {
+      char* pathVar = getenv("PATH");
+      for(const char* str = pathVar; *str;)
+      {
+        const char* end = strchr(str, ':');
+        if(end)
         {
-          result = cygwinRoot;
-          result.append(dest);
+          if(end > str)
+            searchPaths.append(String(str, end - str));
+          ++end;
+          str = end;
         }
         else
         {
-          result = File::getDirname(result);
-          result.append('/');
-          result.append(dest);
+          searchPaths.append(String(str, -1));
+          break;
         }
-        success = true;
       }
-      return false;
+      loaded = true;
     }
+    return searchPaths;
+  }
 
-    static String find(const String& program)
+#ifdef __CYGWIN__
+  static bool fileComplete(const String& searchName, bool testExtensions, String& result)
+  {
+    if(File::exists(searchName))
+    {
+      result = searchName;
+      return true;
+    }
+    if(testExtensions)
     {
-      String result = program;
-      bool testExtensions = File::getExtension(program).isEmpty();
-      // check whether the given path is absolute
-      if(program.getData()[0] == '/' || (program.getLength() > 2 && program.getData()[1] == ':'))
-      { // absolute
-        fileComplete(program, testExtensions, result);
+      String testPath = searchName;
+      testPath.append(".exe");
+      if(File::exists(testPath))
+      {
+        result = testPath;
+        return true;
       }
-      else
-      { // try each search path
-        const List<String>& searchPaths = getPathEnv();
-        for(const List<String>::Node* i = searchPaths.getFirst(); i; i = i->getNext())
+      testPath.setLength(searchName.getLength());
+      testPath.append(".com");
+      if(File::exists(testPath))
+      {
+        result = testPath;
+        return true;
+      }
+    }
+    return false;
+  }
+  static String find(const String& program)
+  {
+    String result = program;
+    bool testExtensions = File::getExtension(program).isEmpty();
+    // check whether the given path is absolute
+    if(program.getData()[0] == '/')
+    { // absolute
+      fileComplete(program, testExtensions, result);
+    }
+    else
+    { // try each search path
+      const List<String>& searchPaths = Executable::getPathEnv();
+      for(const List<String>::Node* i = searchPaths.getFirst(); i; i = i->getNext())
+      {
+        String testPath = i->data;
+        testPath.append('/');
+        testPath.append(program);
+        if(fileComplete(testPath, testExtensions, result))
+          break;
+      }
+    }
+    return result;
+  }
+#else
+  static String find(const String& program)
+  {
+    String result = program;
+    // check whether the given path is absolute
+    if(program.getData()[0] == '/')
+    { // absolute
+      return result;
+    }
+    else
+    { // try each search path
+      const List<String>& searchPaths = Executable::getPathEnv();
+      for(const List<String>::Node* i = searchPaths.getFirst(); i; i = i->getNext())
+      {
+        String testPath = i->data;
+        testPath.append('/');
+        testPath.append(program);
+        if(File::exists(testPath))
         {
-          String testPath = i->data;
-          testPath.append('\\');
-          testPath.append(program);
-          if(fileComplete(testPath, testExtensions, result))
-          {
-            if(strncmp(program.getData(), "../", 3) == 0 || strncmp(program.getData(), "..\\", 3) == 0)
-              result = File::simplifyPath(result);
-            break;
-          }
+          result = testPath;
+          break;
         }
       }
-      return result;
     }
-  };
+    return result;
+  }
+#endif
+};
+#endif
+
+String Process::findProgram(const String& program)
+{
+#ifdef _WIN32
+  return Executable::find(program);
+#else
+  static Map<String, String> cachedProgramPaths;
+  const Map<String, String>::Node* i = cachedProgramPaths.find(program);
+  if(i)
+    return i->data;
+  String programPath = Executable::find(program);
+  cachedProgramPaths.append(program, programPath);
+  return programPath;
+#endif
+}
+
+unsigned int Process::start(const String& rawCommandLine)
+{
+  // split commands into words
+  List<Word> command;
+  Word::split(rawCommandLine, command);
+
+  // separate leading environment variables and the command line
+  Map<String, String> environmentVariables;
+  for(List<Word>::Node* envNode = command.getFirst(); envNode; envNode = command.getFirst())
+  {
+    const char* data = envNode->data.getData();
+    const char* sep = strchr(data, '=');
+    if(sep)
+    {
+      // load list of existing existing variables
+      if(environmentVariables.isEmpty())
+      {
+        const Map<String, String>& envs = getEnvironmentVariables();
+        for(const Map<String, String>::Node* i = envs.getFirst(); i; i = i->getNext())
+          environmentVariables.append(i->key, i->data);
+      }
+
+      // add or override a variable
+      String key(data, sep - data);
+      Map<String, String>::Node* existingNode = environmentVariables.find(key);
+      if(existingNode)
+        existingNode->data = envNode->data;
+      else
+        environmentVariables.append(key, envNode->data);
+
+      //
+      command.removeFirst();
+    }
+    else
+      break;
+  }
 
+#ifdef _WIN32
   String program, programPath;
   static Map<String, String> cachedProgramPaths;
   bool cachedProgramPath = false;
@@ -267,6 +449,28 @@ unsigned int Process::start(const String& rawCommandLine)
   si.cb = sizeof(si);
   ZeroMemory(&pi, sizeof(pi));
 
+  // redirect the output of the process into a temporary file
+  char tempPath[MAX_PATH], tempFile[MAX_PATH];
+  if(!GetTempPath(MAX_PATH, tempPath) || !GetTempFileName(tempPath, "mare", 0, tempFile))
+    return 0;
+  outputFile = tempFile;
+  output.clear();
+  SECURITY_ATTRIBUTES sa;
+  sa.nLength = sizeof(sa);
+  sa.lpSecurityDescriptor = NULL;
+  sa.bInheritHandle = TRUE;
+  HANDLE hOutput = CreateFile(tempFile, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+  if(hOutput == INVALID_HANDLE_VALUE)
+  {
+    DeleteFile(tempFile);
+    return 0;
+  }
+  si.dwFlags |= STARTF_USESTDHANDLES;
+  si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+  si.hStdOutput = hOutput;
+  si.hStdError = hOutput;
+  BOOL inheritHandles = TRUE;
+
   char* envblock = 0;
   if(!environmentVariables.isEmpty())
   {
@@ -298,7 +502,7 @@ unsigned int Process::start(const String& rawCommandLine)
     *p = '\0';
   }
 
-  if(!CreateProcess(programPath.getData(), (char*)commandLine.getData(), NULL, NULL, FALSE, 0, envblock, NULL, &si, &pi))
+  if(!CreateProcess(programPath.getData(), (char*)commandLine.getData(), NULL, NULL, inheritHandles, 0, envblock, NULL, &si, &pi))
   {
     DWORD lastError = GetLastError();
     if(!programPath.isEmpty())
@@ -307,7 +511,7 @@ unsigned int Process::start(const String& rawCommandLine)
       if(Executable::resolveSymlink(programPath, resolvedSymlink))
       {
         programPath = resolvedSymlink;
-        if(CreateProcess(programPath.getData(), (char*)commandLine.getData(), NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+        if(CreateProcess(programPath.getData(), (char*)commandLine.getData(), NULL, NULL, inheritHandles, 0, NULL, NULL, &si, &pi))
           goto success;
         else
           lastError = GetLastError();
@@ -316,6 +520,8 @@ unsigned int Process::start(const String& rawCommandLine)
 
     if(!cachedProgramPath)
       cachedProgramPaths.append(program, programPath);
+    CloseHandle(hOutput);
+    DeleteFile(tempFile);
 
     SetLastError(lastError);
     return 0;
@@ -324,6 +530,7 @@ success:
 
   if(!cachedProgramPath)
     cachedProgramPaths.append(program, programPath);
+  CloseHandle(hOutput);
 
   CloseHandle(pi.hThread);
 
@@ -334,137 +541,69 @@ success:
   return pi.dwProcessId;
 #else
 
-  struct Executable
-  {
-    static const List<String>& getPathEnv()
-    {
-      static List<String> searchPaths;
-      static bool loaded = false;
-      if(!loaded)
-      {
-        char* pathVar = getenv("PATH");
-        for(const char* str = pathVar; *str;)
-        {
-          const char* end = strchr(str, ':');
-          if(end)
-          {
-            if(end > str)
-              searchPaths.append(String(str, end - str));
-            ++end;
-            str = end;
-          }
-          else
-          {
-            searchPaths.append(String(str, -1));
-            break;
-          }
-        }
-        loaded = true;
-      }
-      return searchPaths;
-    }
+  String programPath;
+  if(!command.isEmpty())
+    programPath = findProgram(command.getFirst()->data);
 
-#ifdef __CYGWIN__
-    static bool fileComplete(const String& searchName, bool testExtensions, String& result)
-    {
-      if(File::exists(searchName))
-      {
-        result = searchName;
-        return true;
-      }
-      if(testExtensions)
-      {
-        String testPath = searchName;
-        testPath.append(".exe");
-        if(File::exists(testPath))
-        {
-          result = testPath;
-          return true;
-        }
-        testPath.setLength(searchName.getLength());
-        testPath.append(".com");
-        if(File::exists(testPath))
-        {
-          result = testPath;
-          return true;
-        }
-      }
-      return false;
-    }
-    static String find(const String& program)
-    {
-      String result = program;
-      bool testExtensions = File::getExtension(program).isEmpty();
-      // check whether the given path is absolute
-      if(program.getData()[0] == '/')
-      { // absolute
-        fileComplete(program, testExtensions, result);
-      }
-      else
-      { // try each search path
-        const List<String>& searchPaths = Executable::getPathEnv();
-        for(const List<String>::Node* i = searchPaths.getFirst(); i; i = i->getNext())
-        {
-          String testPath = i->data;
-          testPath.append('/');
-          testPath.append(program);
-          if(fileComplete(testPath, testExtensions, result))
-            break;
-        }
-      }
-      return result;
-    }
-#else
-    static String find(const String& program)
-    {
-      String result = program;
-      // check whether the given path is absolute
-      if(program.getData()[0] == '/')
-      { // absolute
-        return result;
-      }
-      else
-      { // try each search path
-        const List<String>& searchPaths = Executable::getPathEnv();
-        for(const List<String>::Node* i = searchPaths.getFirst(); i; i = i->getNext())
-        {
-          String testPath = i->data;
-          testPath.append('/');
-          testPath.append(program);
-          if(File::exists(testPath))
-          {
-            result = testPath;
-            break;
-          }
-        }
-      }
-      return result;
-    }
+#ifdef __linux
+  if(epollFd == -1)
+  {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(epollFd == -1)
+      return 0;
+  }
 #endif
-  };
-
-  String program, programPath;
-  static Map<String, String> cachedProgramPaths;
-  if(!command.isEmpty())
+  static bool signalForwardingInstalled = false;
+  if(!signalForwardingInstalled)
   {
-    program = command.getFirst()->data;
-    const Map<String, String>::Node* i = cachedProgramPaths.find(program);
-    if(i)
-      programPath = i->data;
-    else
-    {
-      programPath = Executable::find(program);
-      cachedProgramPaths.append(program, programPath);
-    }
+    installSignalForwarding();
+    signalForwardingInstalled = true;
   }
 
+  // create a pipe for the output of the process
+  int fds[2];
+#ifdef __linux
+  if(pipe2(fds, O_CLOEXEC) == -1)
+    return 0;
+#else
+  if(pipe(fds) == -1)
+    return 0;
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
   int r = vfork();
   if(r == -1)
+  {
+    close(fds[0]);
+    close(fds[1]);
     return 0;
+  }
   else if(r != 0) // parent
   {
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
     pid = r;
+    outputFd = fds[0];
+    output.clear();
+    sigset_t previousMask;
+    sigprocmask(SIG_BLOCK, &forwardedSignals, &previousMask); // the signal handlers iterate over the running processes
     runningProcesses.append(pid, this);
+    sigprocmask(SIG_SETMASK, &previousMask, 0);
+#ifdef __linux
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = (unsigned long long)pid << 1;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, outputFd, &event);
+#ifdef SYS_pidfd_open
+    pidFd = (int)syscall(SYS_pidfd_open, (pid_t)pid, 0);
+    if(pidFd != -1)
+    {
+      event.data.u64 = ((unsigned long long)pid << 1) | 1;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, pidFd, &event);
+    }
+#endif
+#endif
     return r;
   }
   else // child
@@ -485,6 +624,12 @@ success:
       envp[i] = 0;
     }
 
+    // start a process group, so that the processes started by the process can be terminated along with it
+    setpgid(0, 0);
+
+    if(dup2(fds[1], STDOUT_FILENO) == -1 || dup2(fds[1], STDERR_FILENO) == -1)
+      _exit(EXIT_FAILURE);
+
     const char* executable = programPath.getData();
     if(execve(executable, (char* const*)argv, (char* const*)envp) == -1)
     {
@@ -507,8 +652,28 @@ unsigned int Process::join()
   }
   DWORD exitCode = 0;
   GetExitCodeProcess(hProcess, &exitCode);
+  PROCESS_MEMORY_COUNTERS pmc;
+  if(GetProcessMemoryInfo(hProcess, &pmc, sizeof(pmc)))
+    peakMemory = pmc.PeakWorkingSetSize;
+  FILETIME creationTime, exitTime, kernelTime, userTime;
+  if(GetProcessTimes(hProcess, &creationTime, &exitTime, &kernelTime, &userTime))
+    cpuTime = (long long)((((unsigned long long)kernelTime.dwHighDateTime << 32 | kernelTime.dwLowDateTime) + ((unsigned long long)userTime.dwHighDateTime << 32 | userTime.dwLowDateTime)) / 10);
   CloseHandle((HANDLE)hProcess);
   hProcess = INVALID_HANDLE_VALUE;
+
+  // collect the output of the process
+  {
+    File file;
+    if(file.open(outputFile))
+    {
+      char buffer[4096];
+      size_t i;
+      while((i = file.read(buffer, sizeof(buffer))) > 0)
+        output.append(buffer, i);
+    }
+  }
+  DeleteFile(outputFile.getData());
+  outputFile.clear();
   return exitCode;
 #else
   if(!pid)
@@ -521,7 +686,86 @@ unsigned int Process::join()
 #endif
 }
 
-unsigned int Process::waitOne()
+void Process::kill()
+{
+#ifdef _WIN32
+  if(hProcess != INVALID_HANDLE_VALUE)
+    TerminateProcess((HANDLE)hProcess, 1);
+#else
+  if(pid && ::kill(-(pid_t)pid, SIGTERM) == -1)
+    ::kill((pid_t)pid, SIGTERM); // the process has not started its process group
+#endif
+}
+
+#ifndef _WIN32
+/**
+* Reads the available output of the process from its pipe
+* @return Whether the pipe is still open
+*/
+bool Process::readOutput()
+{
+  char buffer[4096];
+  for(;;)
+  {
+    ssize_t i = read(outputFd, buffer, sizeof(buffer));
+    if(i > 0)
+      output.append(buffer, i);
+    else if(i == -1 && errno == EINTR)
+      continue;
+    else if(i == -1 && errno == EAGAIN)
+      return true;
+    else
+      return false;
+  }
+}
+
+/**
+* Collects the remaining output and the exit code of a process
+* @param terminated Whether the process is known to be terminated. Otherwise, this waits until it terminates.
+*/
+void Process::finish(bool terminated)
+{
+  if(outputFd != -1)
+  {
+    if(terminated)
+      readOutput(); // the output of child processes that are still running is ignored
+    close(outputFd);
+    outputFd = -1;
+  }
+  if(pidFd != -1)
+  {
+    close(pidFd);
+    pidFd = -1;
+  }
+
+  int status;
+  struct rusage usage;
+  pid_t result;
+  while((result = wait4((pid_t)pid, &status, 0, &usage)) == -1 && errno == EINTR);
+  if(result == -1)
+    exitCode = 1;
+  else
+  {
+    exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+#ifdef __APPLE__
+    peakMemory = (unsigned long long)usage.ru_maxrss;
+#else
+    peakMemory = (unsigned long long)usage.ru_maxrss * 1024ULL;
+#endif
+    cpuTime = (long long)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  }
+  Map<pid_t, Process*>::Node* node = runningProcesses.find((pid_t)pid);
+  if(node)
+  {
+    sigset_t previousMask;
+    sigprocmask(SIG_BLOCK, &forwardedSignals, &previousMask);
+    runningProcesses.remove(node);
+    sigprocmask(SIG_SETMASK, &previousMask, 0);
+  }
+}
+#endif
+
+unsigned int Process::waitOne(int timeout)
 {
 #ifdef _WIN32
   if(runningProcessHandles.isEmpty())
@@ -529,8 +773,8 @@ unsigned int Process::waitOne()
     SetLastError(ERROR_NOT_READY);
     return 0;
   }
-  DWORD index = WaitForMultipleObjects(static_cast<DWORD>(runningProcessHandles.getSize()), runningProcessHandles.getFirst(), FALSE, INFINITE);
-  if(index == WAIT_FAILED)
+  DWORD index = WaitForMultipleObjects(static_cast<DWORD>(runningProcessHandles.getSize()), runningProcessHandles.getFirst(), FALSE, timeout < 0 ? INFINITE : (DWORD)timeout);
+  if(index == WAIT_FAILED || index == WAIT_TIMEOUT)
     return 0;
   index -= WAIT_OBJECT_0;
   ASSERT(index >= 0 && index < runningProcessHandles.getSize());
@@ -540,34 +784,251 @@ unsigned int Process::waitOne()
 
   return GetProcessId(handle);
 #else
-  int status;
-  pid_t pid = wait(&status);
-  if(pid == -1)
+  if(runningProcesses.isEmpty())
+  {
+    errno = ECHILD;
     return 0;
-  Map<pid_t, Process*>::Node* i = runningProcesses.find(pid);
-  if(i)
+  }
+  long long deadline = timeout < 0 ? 0 : Clock::getMicroseconds() + timeout * 1000LL;
+  for(;;)
   {
-    i->data->exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
-    runningProcesses.remove(i);
+    if(timeout > 0)
+    {
+      long long now = Clock::getMicroseconds();
+      timeout = now >= deadline ? 0 : (int)((deadline - now + 999) / 1000);
+    }
+
+#ifdef __linux
+    // a process terminated when its pidfd becomes readable or (without pidfd) when its output pipe was closed
+    struct epoll_event events[16];
+    int count = epoll_wait(epollFd, events, sizeof(events) / sizeof(*events), timeout);
+    if(count == -1)
+    {
+      if(errno == EINTR)
+        continue;
+      return 0;
+    }
+    if(count == 0)
+      return 0;
+    for(int i = 0; i < count; ++i)
+    {
+      pid_t pid = (pid_t)(events[i].data.u64 >> 1);
+      Map<pid_t, Process*>::Node* node = runningProcesses.find(pid);
+      if(!node)
+        continue;
+      Process* process = node->data;
+      if(events[i].data.u64 & 1)
+      {
+        process->finish(true);
+        return pid;
+      }
+      if(process->outputFd != -1 && !process->readOutput())
+      {
+        close(process->outputFd); // closing removes the file descriptor from the epoll set
+        process->outputFd = -1;
+        if(process->pidFd == -1)
+        {
+          process->finish(false);
+          return pid;
+        }
+      }
+    }
+#else
+    // a process terminated when its output pipe was closed
+    size_t processCount = runningProcesses.getSize();
+    struct pollfd* fds = (struct pollfd*)alloca(sizeof(struct pollfd) * processCount);
+    Process** processes = (Process**)alloca(sizeof(Process*) * processCount);
+    size_t fdCount = 0;
+    for(Map<pid_t, Process*>::Node* i = runningProcesses.getFirst(); i; i = i->getNext())
+    {
+      if(i->data->outputFd == -1)
+        continue;
+      fds[fdCount].fd = i->data->outputFd;
+      fds[fdCount].events = POLLIN;
+      fds[fdCount].revents = 0;
+      processes[fdCount++] = i->data;
+    }
+    int count = poll(fds, (nfds_t)fdCount, timeout);
+    if(count == -1)
+    {
+      if(errno == EINTR)
+        continue;
+      return 0;
+    }
+    if(count == 0)
+      return 0;
+    for(size_t i = 0; i < fdCount; ++i)
+      if(fds[i].revents)
+      {
+        Process* process = processes[i];
+        if(!process->readOutput())
+        {
+          pid_t pid = process->pid;
+          process->finish(false);
+          return pid;
+        }
+      }
+#endif
   }
-  return pid;
 #endif
 }
 
+#ifdef __linux
+/**
+* Reads a small text file (e.g. from procfs or sysfs)
+* @param file The path to the file
+* @param buffer A buffer that receives the null-terminated content of the file
+* @param size The size of the buffer
+* @return Whether the file could be read
+*/
+static bool readTextFile(const String& file, char* buffer, size_t size)
+{
+  File f;
+  if(!f.open(file))
+    return false;
+  size_t length = f.read(buffer, size - 1);
+  buffer[length] = '\0';
+  return length > 0;
+}
+
+/** Returns the directory of the cgroup (v2) of the current process or an empty string if it cannot be determined */
+static String getCgroupDirectory()
+{
+  char buffer[4096];
+  if(!readTextFile("/proc/self/cgroup", buffer, sizeof(buffer)))
+    return String();
+  for(const char* line = buffer; *line; )
+  {
+    const char* end = strchr(line, '\n');
+    if(!end)
+      end = line + strlen(line);
+    if(strncmp(line, "0::", 3) == 0)
+    {
+      String dir("/sys/fs/cgroup");
+      if(line[3] == '/' && end - line > 4)
+        dir.append(line + 3, end - line - 3);
+      return dir;
+    }
+    line = *end ? end + 1 : end;
+  }
+  return String();
+}
+#endif
+
 unsigned  int Process::getProcessorCount()
 {
 #if defined(_WIN32)
+  DWORD_PTR processAffinityMask, systemAffinityMask;
+  if(GetProcessAffinityMask(GetCurrentProcess(), &processAffinityMask, &systemAffinityMask) && processAffinityMask)
+  {
+    unsigned int count = 0;
+    for(; processAffinityMask; processAffinityMask &= processAffinityMask - 1)
+      ++count;
+    return count;
+  }
   SYSTEM_INFO si;
   GetSystemInfo(&si);
   return si.dwNumberOfProcessors;
 //#elif defined(__linux)
 #else
-  return sysconf(_SC_NPROCESSORS_CONF);
+  long count = sysconf(_SC_NPROCESSORS_CONF);
+#ifdef __linux
+  // respect the cpu affinity mask
+  cpu_set_t cpuSet;
+  if(sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+  {
+    long affinityCount = CPU_COUNT(&cpuSet);
+    if(affinityCount > 0 && affinityCount < count)
+      count = affinityCount;
+  }
+
+  // respect the cpu bandwidth limits of the cgroup and its parents
+  String dir = getCgroupDirectory();
+  while(dir.getLength() >= sizeof("/sys/fs/cgroup") - 1)
+  {
+    char buffer[128];
+    long long quota, period;
+    if(readTextFile(dir + "/cpu.max", buffer, sizeof(buffer)) && sscanf(buffer, "%lld %lld", &quota, &period) == 2 && quota > 0 && period > 0)
+    {
+      long quotaCount = (long)((quota + period - 1) / period);
+      if(quotaCount < count)
+        count = quotaCount;
+    }
+    dir = File::getDirname(dir);
+  }
+#endif
+  return count > 0 ? (unsigned int)count : 1;
 //#else
   //return 1;
 #endif
 }
 
+bool Process::getAvailableMemory(unsigned long long& size)
+{
+#ifdef _WIN32
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if(!GlobalMemoryStatusEx(&status))
+    return false;
+  size = status.ullAvailPhys;
+  return true;
+#elif defined(__linux)
+  char buffer[4096];
+  if(!readTextFile("/proc/meminfo", buffer, sizeof(buffer)))
+    return false;
+  const char* memAvailable = strstr(buffer, "MemAvailable:");
+  unsigned long long available;
+  if(!memAvailable || sscanf(memAvailable, "MemAvailable: %llu kB", &available) != 1)
+    return false;
+  size = available * 1024ULL;
+
+  // respect the memory limits of the cgroup and its parents
+  String dir = getCgroupDirectory();
+  while(dir.getLength() >= sizeof("/sys/fs/cgroup") - 1)
+  {
+    char buffer[64];
+    unsigned long long max, current;
+    if(readTextFile(dir + "/memory.max", buffer, sizeof(buffer)) && sscanf(buffer, "%llu", &max) == 1 &&
+       readTextFile(dir + "/memory.current", buffer, sizeof(buffer)) && sscanf(buffer, "%llu", &current) == 1)
+    {
+      unsigned long long cgroupAvailable = current < max ? max - current : 0;
+      if(cgroupAvailable < size)
+        size = cgroupAvailable;
+    }
+    dir = File::getDirname(dir);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Process::getLoadAverage(double& load)
+{
+#ifdef _WIN32
+  return false;
+#else
+  double loads[1];
+  if(getloadavg(loads, 1) != 1)
+    return false;
+  load = loads[0];
+  return true;
+#endif
+}
+
+bool Process::getCpuPressure(double& pressure)
+{
+#ifdef __linux
+  char buffer[256];
+  String dir = getCgroupDirectory();
+  if((dir.isEmpty() || !readTextFile(dir + "/cpu.pressure", buffer, sizeof(buffer))) && !readTextFile("/proc/pressure/cpu", buffer, sizeof(buffer)))
+    return false;
+  return sscanf(buffer, "some avg10=%lf", &pressure) == 1;
+#else
+  return false;
+#endif
+}
+
 String Process::getArchitecture()
 {
 #ifndef _WIN32
@@ -13,7 +13,9 @@ public:
   ~Process();
 
   /**
-  * Starts the execution of a process
+  * Starts the execution of a process. The standard output and error output of the process are collected and can be
+  * retrieved with \c getOutput() when the process was joined. On Unix, the process is started in a process group of its
+  * own, and the signals SIGINT, SIGTERM and SIGHUP are forwarded to the process groups of the running processes.
   * @param command The command used to start the process. The first word in \c command should be a path to the executable. All other words in \c command are used as arguments for launching the process.
   * @return The process id of the newly started process or \c 0 if an errors occured
   */
@@ -27,12 +29,71 @@ public:
 
   unsigned int join();
 
-  static unsigned int waitOne();
+  /** Terminates the running process and the processes it started. The process still has to be joined when it has terminated. */
+  void kill();
 
+  /**
+  * Returns the peak memory usage (resident set size) of a process that was joined
+  * @return The peak memory usage in bytes or \c 0 if unknown
+  */
+  unsigned long long getPeakMemory() const {return peakMemory;}
+
+  /**
+  * Returns the processor time (user and system time) used by a process that was joined
+  * @return The processor time in microseconds
+  */
+  long long getCpuTime() const {return cpuTime;}
+
+  /**
+  * Returns the standard output and error output of a process that was joined
+  */
+  const String& getOutput() const {return output;}
+
+  /**
+  * Waits for the termination of a started process
+  * @param timeout The maximum time to wait in milliseconds or \c -1 to wait until a process terminates
+  * @return The process id of the terminated process or \c 0 if no process terminated within \c timeout or if an error occured
+  */
+  static unsigned int waitOne(int timeout = -1);
+
+  /**
+  * Returns the number of processors that can be used by the current process. The count respects the processor
+  * affinity of the process and (on Linux) the cpu bandwidth limit of its cgroup.
+  */
   static unsigned  int getProcessorCount();
 
+  /**
+  * Returns the system load average of the last minute
+  * @param load The load average
+  * @return Whether the load average is available
+  */
+  static bool getLoadAverage(double& load);
+
+  /**
+  * Returns the amount of memory that is available for starting new processes. On Linux the memory limit of the
+  * process's cgroup is respected.
+  * @param size The amount of available memory in bytes
+  * @return Whether the amount of available memory could be determined
+  */
+  static bool getAvailableMemory(unsigned long long& size);
+
+  /**
+  * Returns the percentage of time in which runnable processes were waiting for a processor during the last ten
+  * seconds (the cpu pressure stall information of Linux)
+  * @param pressure The pressure in percent
+  * @return Whether the pressure stall information is available
+  */
+  static bool getCpuPressure(double& pressure);
+
   static String getArchitecture();
 
+  /**
+  * Searches an executable in the directories listed in the PATH environment variable
+  * @param program The name of or the path to the executable
+  * @return The path to the executable
+  */
+  static String findProgram(const String& program);
+
   /**
   * Returns the environment variables of the current process.
   * @return A map that contains the environment variables.
@@ -40,10 +101,19 @@ public:
   static const Map<String, String>& getEnvironmentVariables();
 
 private:
+  unsigned long long peakMemory;
+  long long cpuTime;
+  String output;
 #ifdef _WIN32
   void* hProcess;
+  String outputFile; /**< A temporary file that receives the output of the process */
 #else
   unsigned int pid;
   unsigned int exitCode;
+  int outputFd; /**< The reading end of the pipe that receives the output of the process or \c -1 */
+  int pidFd; /**< A file descriptor referring to the process (on Linux) or \c -1 */
+
+  bool readOutput();
+  void finish(bool terminated);
 #endif
 };
@@ -7,6 +7,7 @@
 
 #include "Assert.h"
 #include "String.h"
+#include "Hash.h"
 
 String::Data String::emptyData("");
 String::Data* String::firstFreeData = 0;
@@ -457,3 +458,8 @@ String& String::uppercase()
     *str = toupper(*(unsigned char*)str);
   return *this;
 }
+
+size_t String::hash() const
+{
+  return (size_t)Hash().append(data->str, data->length).get();
+}
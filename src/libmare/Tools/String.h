@@ -72,6 +72,9 @@ public:
   String& lowercase();
   String& uppercase();
 
+  /** Returns a hash of the characters of the string */
+  size_t hash() const;
+
 private:
   class Data
   {
@@ -96,3 +99,6 @@ private:
   void free();
   void grow(size_t capacity, size_t length);
 };
+
+/** Returns the hash of a key string of a map */
+inline size_t hashKey(const String& key) {return key.hash();}
@@ -0,0 +1,332 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Tools/Clock.h"
+#include "Tools/Directory.h"
+#include "Tools/File.h"
+#include "Tools/List.h"
+#include "Tools/Map.h"
+#include "Tools/String.h"
+#include "Engine.h"
+
+/*
+* Benchmarks for parts of mare that are not visible in the timing of a normal build. The results are printed in
+* milliseconds. Comparing an optimization with the previous implementation requires building mare-bench at both
+* revisions (e.g. by copying this directory into a checkout of the previous revision).
+*/
+
+static void errorHandler(void* userData, const String& file, int line, const String& message)
+{
+  if(line < 0)
+    fprintf(stderr, "%s: %s\n", file.isEmpty() ? (const char*)userData : file.getData(), message.getData());
+  else
+    fprintf(stderr, "%s:%d: error: %s\n", file.getData(), line, message.getData());
+}
+
+static bool writeFile(const String& path, const String& data)
+{
+  File file;
+  if(!file.open(path, File::writeFlag) || !file.write(data))
+  {
+    fprintf(stderr, "mare-bench: %s: cannot write file\n", path.getData());
+    return false;
+  }
+  return true;
+}
+
+/**
+* Generates a Marefile with many targets whose keys depend on conditions, "+=" and "-=" assignments, inherited lists
+* and variable references
+* @param targets The number of targets
+* @param files The number of source files of each target
+* @return The content of the Marefile
+*/
+static String generateMarefile(unsigned int targets, unsigned int files)
+{
+  String marefile;
+  marefile.append("\nconfigurations = { Debug, Release }\nplatforms = { Linux, Win32 }\n\n");
+  marefile.append("cppFlags = \"-Wall -pipe\"\n\n");
+  marefile.append("common = {\n");
+  marefile.append("  cppFlags += {\n");
+  marefile.append("    if configuration == \"Debug\" { \"-g\" } else { \"-O2\" }\n");
+  marefile.append("    if configuration != \"Debug\" && !(platform == \"Win32\") { \"-fomit-frame-pointer\" }\n");
+  marefile.append("  }\n");
+  marefile.append("  defines = { \"TARGET_$(upper $(target))\" }\n");
+  marefile.append("  if configuration == \"Release\" || platform == \"Win32\" { defines += \"NDEBUG\" }\n");
+  marefile.append("  output = \"build/$(platform)/$(configuration)/$(target)$(if $(Win32),.exe)\"\n");
+  marefile.append("  input = \"$(foreach file,$(files),build/$(platform)/$(configuration)/$(basename $(file)).o)\"\n");
+  marefile.append("  command = \"g++ -o $(output) $(input) $(patsubst %,-l%,$(libs))\"\n");
+  marefile.append("}\n\n");
+  marefile.append("compile = {\n");
+  marefile.append("  input = \"$(file)\"\n");
+  marefile.append("  output = \"build/$(platform)/$(configuration)/$(basename $(file)).o\"\n");
+  marefile.append("  command = \"g++ $(cppFlags) $(patsubst %,-D%,$(defines)) $(patsubst %,-I%,$(includePaths)) -c $(file) -o $(output)\"\n");
+  marefile.append("}\n\n");
+  marefile.append("targets = {\n");
+  for(unsigned int i = 0; i < targets; ++i)
+  {
+    marefile.append(String().format(256, "  t%u = common + {\n", i));
+    marefile.append(String().format(256, "    defines += { \"T%u\" if platform == \"Linux\" { \"LINUX\" } }\n", i));
+    marefile.append("    cppFlags -= \"-pipe\"\n");
+    marefile.append(String().format(256, "    includePaths = { \"include\", \"src/t%u\" }\n", i));
+    if(i > 0)
+      marefile.append(String().format(256, "    dependencies = { \"t%u\" }\n    libs = { \"t%u\" }\n", i - 1, i - 1));
+    marefile.append("    files = {\n");
+    for(unsigned int j = 0; j < files; ++j)
+      marefile.append(String().format(256, "      \"src/t%u/f%u.cpp\" = compile\n", i, j));
+    marefile.append("    }\n");
+    marefile.append("  }\n");
+  }
+  marefile.append("}\n");
+  return marefile;
+}
+
+/**
+* Evaluates the rules of all targets of a loaded Marefile like mare does for a build
+* @param engine The engine
+* @return The number of evaluated commands
+*/
+static unsigned int evaluateRules(Engine& engine)
+{
+  unsigned int commands = 0;
+  List<String> platforms, configurations, targets, files, keys;
+  engine.enterRootKey();
+  engine.getKeys("platforms", platforms);
+  engine.getKeys("configurations", configurations);
+  engine.getKeys("targets", targets);
+  engine.leaveKey();
+  for(const List<String>::Node* i = platforms.getFirst(); i; i = i->getNext())
+    for(const List<String>::Node* j = configurations.getFirst(); j; j = j->getNext())
+      for(const List<String>::Node* k = targets.getFirst(); k; k = k->getNext())
+      {
+        engine.enterUnnamedKey();
+        engine.addDefaultKey("platform", i->data);
+        engine.addDefaultKey(i->data, i->data);
+        engine.addDefaultKey("configuration", j->data);
+        engine.addDefaultKey(j->data, j->data);
+        engine.addDefaultKey("target", k->data);
+        engine.enterRootKey();
+        engine.enterKey("targets");
+        engine.enterKey(k->data);
+        if(engine.enterKey("files"))
+        {
+          files.clear();
+          engine.getKeys(files);
+          for(const List<String>::Node* l = files.getFirst(); l; l = l->getNext())
+          {
+            engine.enterUnnamedKey();
+            engine.addDefaultKey("file", l->data);
+            engine.enterKey(l->data);
+            keys.clear();
+            engine.getKeys("input", keys, false);
+            engine.getKeys("output", keys, false);
+            engine.getText("command", keys, false);
+            commands += keys.isEmpty() ? 0 : 1;
+            engine.leaveKey();
+            engine.leaveKey();
+          }
+          engine.leaveKey();
+        }
+        keys.clear();
+        engine.getKeys("dependencies", keys, false);
+        engine.getKeys("input", keys, false);
+        engine.getKeys("output", keys, false);
+        engine.getText("command", keys, false);
+        commands += keys.isEmpty() ? 0 : 1;
+        engine.leaveKey();
+        engine.leaveKey();
+        engine.leaveKey();
+        engine.leaveKey();
+      }
+  return commands;
+}
+
+/**
+* Measures the time needed for parsing and evaluating a large generated Marefile
+* @param targets The number of targets of the Marefile
+* @param rounds The number of times the Marefile is loaded into a new engine and evaluated
+* @return An exit code
+*/
+static int benchmarkEvaluation(unsigned int targets, unsigned int rounds)
+{
+  const unsigned int files = 20;
+  const char* tmpDir = getenv("TMPDIR");
+  String path = String(tmpDir && *tmpDir ? tmpDir : ".", -1) + "/mare-bench.marefile";
+  if(!writeFile(path, generateMarefile(targets, files)))
+    return EXIT_FAILURE;
+
+  long long bestParseTime = 0, bestEvaluationTime = 0;
+  unsigned int commands = 0;
+  for(unsigned int i = 0; i < rounds; ++i)
+  {
+    Engine engine(errorHandler, (void*)"mare-bench");
+    long long startTime = Clock::getMicroseconds();
+    if(!engine.load(path))
+    {
+      File::unlink(path);
+      return EXIT_FAILURE;
+    }
+    long long parseTime = Clock::getMicroseconds() - startTime;
+    startTime = Clock::getMicroseconds();
+    commands = evaluateRules(engine);
+    long long evaluationTime = Clock::getMicroseconds() - startTime;
+    if(i == 0 || parseTime < bestParseTime)
+      bestParseTime = parseTime;
+    if(i == 0 || evaluationTime < bestEvaluationTime)
+      bestEvaluationTime = evaluationTime;
+  }
+  File::unlink(path);
+
+  printf("evaluate: %u targets with %u files, 2 platforms, 2 configurations (%u commands)\n", targets, files, commands);
+  printf("  parse:      %10.3f ms (best of %u)\n", bestParseTime / 1000., rounds);
+  printf("  evaluation: %10.3f ms (best of %u)\n", bestEvaluationTime / 1000., rounds);
+  return EXIT_SUCCESS;
+}
+
+/**
+* Measures the time needed for appending, finding and removing the keys of maps
+* @param name The name of the key type
+* @param keys The keys
+* @param size The number of keys
+*/
+template <typename K> static void benchmarkMap(const char* name, const K* keys, unsigned int size)
+{
+  // fill multiple maps at once so that the clock is not read between the operations on small maps
+  unsigned int rounds = size < 200000 ? 200000 / size : 1;
+  Map<K, unsigned int>* maps = new Map<K, unsigned int>[rounds];
+  unsigned int found = 0;
+  long long startTime = Clock::getMicroseconds();
+  for(unsigned int i = 0; i < rounds; ++i)
+    for(unsigned int j = 0; j < size; ++j)
+      maps[i].append(keys[j], j);
+  long long appendTime = Clock::getMicroseconds() - startTime;
+  startTime = Clock::getMicroseconds();
+  for(unsigned int i = 0; i < rounds; ++i)
+    for(unsigned int j = 0; j < size; ++j)
+      if(maps[i].find(keys[j]))
+        ++found;
+  long long findTime = Clock::getMicroseconds() - startTime;
+  startTime = Clock::getMicroseconds();
+  for(unsigned int i = 0; i < rounds; ++i)
+    for(unsigned int j = size; j-- > 0;)
+      maps[i].remove(maps[i].find(keys[j]));
+  long long removeTime = Clock::getMicroseconds() - startTime;
+  delete[] maps;
+
+  double operations = (double)rounds * size / 1000.;
+  printf("  %-7s %6u keys: append %8.1f ns, find %8.1f ns, find and remove %8.1f ns%s\n", name, size,
+    appendTime / operations, findTime / operations, removeTime / operations, found == rounds * size ? "" : " (keys not found)");
+}
+
+/**
+* Measures the time per operation of maps with different numbers of keys
+* @return An exit code
+*/
+static int benchmarkMaps()
+{
+  static const unsigned int sizes[] = {8, 1000, 40000};
+  const unsigned int maxSize = 40000;
+  String* strings = new String[maxSize];
+  unsigned int* values = new unsigned int[maxSize];
+  unsigned int** pointers = new unsigned int*[maxSize];
+  for(unsigned int i = 0; i < maxSize; ++i)
+  {
+    strings[i] = String().format(256, "build/Linux/Debug/src/t%u/f%u.o", i / 400, i % 400);
+    pointers[i] = &values[i];
+  }
+  printf("map:\n");
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i)
+  {
+    benchmarkMap("String", strings, sizes[i]);
+    benchmarkMap("pointer", pointers, sizes[i]);
+  }
+  delete[] strings;
+  delete[] values;
+  delete[] pointers;
+  return EXIT_SUCCESS;
+}
+
+/**
+* Generates a project with many source files for measuring the time mare needs before it starts the first command
+* @param dir The directory of the project
+* @param files The number of source files (400 per static library)
+* @return An exit code
+*/
+static int generateProject(const String& dir, unsigned int files)
+{
+  const unsigned int filesPerTarget = 400;
+  unsigned int targets = (files + filesPerTarget - 1) / filesPerTarget;
+  String marefile("\ntargets = {\n  app = cppApplication + {\n    dependencies = {");
+  for(unsigned int i = 0; i < targets; ++i)
+    marefile.append(String().format(256, " t%u", i));
+  marefile.append(" }\n    files = {\n      \"src/main.cpp\" = cppSource\n    }\n  }\n");
+  for(unsigned int i = 0; i < targets; ++i)
+    marefile.append(String().format(256, "  t%u = cppStaticLibrary + {\n    files = {\n      \"src/t%u/**.cpp\" = cppSource\n    }\n  }\n", i, i));
+  marefile.append("}\n");
+  if(!Directory::create(dir + "/src") || !writeFile(dir + "/Marefile", marefile) || !writeFile(dir + "/src/main.cpp", "int main() {return 0;}\n"))
+    return EXIT_FAILURE;
+  for(unsigned int i = 0; i < files; ++i)
+  {
+    String targetDir = dir + String().format(256, "/src/t%u", i / filesPerTarget);
+    if(i % filesPerTarget == 0 && !Directory::create(targetDir))
+      return EXIT_FAILURE;
+    if(!writeFile(targetDir + String().format(256, "/f%u.cpp", i % filesPerTarget), String().format(256, "int f%u() {return %u;}\n", i, i)))
+      return EXIT_FAILURE;
+  }
+  printf("generate: %u source files in %u static libraries in \"%s\"\n", files, targets, dir.getData());
+  return EXIT_SUCCESS;
+}
+
+static void showUsage(const char* executable)
+{
+  String basename = File::getBasename(String(executable, -1));
+  printf("Usage: %s evaluate [<targets>] [<rounds>]\n", basename.getData());
+  printf("       %s map\n", basename.getData());
+  printf("       %s generate <dir> [<files>]\n", basename.getData());
+  puts("");
+  puts("Runs benchmarks of mare.");
+  puts("");
+  puts("Benchmarks:");
+  puts("");
+  puts("    evaluate [<targets>] [<rounds>]");
+  puts("        Generate a Marefile with <targets> targets (500 by default) and");
+  puts("        measure the time needed for parsing it and for evaluating the rules");
+  puts("        of all targets. The best time of <rounds> runs (3 by default) is");
+  puts("        reported.");
+  puts("");
+  puts("    map");
+  puts("        Measure the time per append, find and remove operation of maps with");
+  puts("        8, 1000 and 40000 keys.");
+  puts("");
+  puts("    generate <dir> [<files>]");
+  puts("        Generate a project with <files> source files (40000 by default) in");
+  puts("        <dir>. The time mare needs for resolving the rules of the project can");
+  puts("        be measured with \"mare clean\" in <dir>.");
+  puts("");
+  exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+    showUsage(argv[0]);
+  if(strcmp(argv[1], "evaluate") == 0 && argc <= 4)
+  {
+    unsigned int targets = argc > 2 ? (unsigned int)strtoul(argv[2], 0, 10) : 500;
+    unsigned int rounds = argc > 3 ? (unsigned int)strtoul(argv[3], 0, 10) : 3;
+    if(targets > 0 && rounds > 0)
+      return benchmarkEvaluation(targets, rounds);
+  }
+  if(strcmp(argv[1], "map") == 0 && argc == 2)
+    return benchmarkMaps();
+  if(strcmp(argv[1], "generate") == 0 && (argc == 3 || argc == 4))
+  {
+    unsigned int files = argc > 3 ? (unsigned int)strtoul(argv[3], 0, 10) : 40000;
+    if(files > 0)
+      return generateProject(String(argv[2], -1), files);
+  }
+  fprintf(stderr, "Type '%s --help' for help\n", argv[0]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,639 @@
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <getopt.h>
+#include <ftw.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include "Tools/Directory.h"
+#include "Tools/Error.h"
+#include "Tools/File.h"
+#include "Tools/List.h"
+#include "Tools/Process.h"
+#include "Tools/String.h"
+
+/*
+* The worker protocol: A client opens a connection and sends a request, which consists of the token of the worker, the
+* command line, the input files (a path relative to the working directory of the client, the permissions and the content
+* of each file) and the paths of the output files. The worker executes the command in a temporary directory that mirrors
+* the relative paths of the files and replies with the exit code and the console output of the command and with the
+* permissions and content of each output file. All numbers are 32-bit unsigned integers in host byte order and strings
+* are sent as a length followed by the characters.
+*
+* The worker executes any command of a request with the token, so the token has to be kept secret. It is sent
+* unencrypted, hence TCP addresses should only be used in trusted networks (or through a tunnel).
+*/
+
+#ifndef _WIN32
+static const unsigned int protocolMagic = 0x3252414d; // "MAR2"
+static const unsigned int maxTokenLength = 1024;
+static const int submitFailure = 125; /**< The exit code of a submission that was not executed by the worker (mare executes the command locally then) */
+
+class InputFile
+{
+public:
+  String path;
+  unsigned int permissions;
+  String content;
+};
+
+static bool writeAll(int fd, const char* data, size_t size)
+{
+  while(size > 0)
+  {
+    ssize_t i = write(fd, data, size);
+    if(i < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+    data += i;
+    size -= i;
+  }
+  return true;
+}
+
+static bool readAll(int fd, char* data, size_t size)
+{
+  while(size > 0)
+  {
+    ssize_t i = read(fd, data, size);
+    if(i <= 0)
+    {
+      if(i < 0 && errno == EINTR)
+        continue;
+      return false;
+    }
+    data += i;
+    size -= i;
+  }
+  return true;
+}
+
+static void appendUInt(String& message, unsigned int value)
+{
+  message.append((const char*)&value, sizeof(value));
+}
+
+static void appendString(String& message, const String& str)
+{
+  appendUInt(message, (unsigned int)str.getLength());
+  message.append(str);
+}
+
+static bool readUInt(int fd, unsigned int& value)
+{
+  return readAll(fd, (char*)&value, sizeof(value));
+}
+
+static bool readString(int fd, String& str)
+{
+  unsigned int length;
+  if(!readUInt(fd, length))
+    return false;
+  str = String();
+  if(!length)
+    return true;
+  char* data = str.getData(length);
+  if(!readAll(fd, data, length))
+    return false;
+  str.setLength(length);
+  return true;
+}
+
+static bool readFile(const String& path, String& data)
+{
+  File file;
+  if(!file.open(path))
+    return false;
+  char buffer[16384];
+  size_t i;
+  while((i = file.read(buffer, sizeof(buffer))) > 0)
+    data.append(buffer, i);
+  return true;
+}
+
+static bool writeFile(const String& path, const String& data, unsigned int permissions)
+{
+  Directory::create(File::getDirname(path));
+  File file;
+  if(!file.open(path, File::writeFlag) || !file.write(data))
+    return false;
+  file.close();
+  if(permissions)
+    File::setPermissions(path, permissions);
+  return true;
+}
+
+/** Returns the token that is required for (or sent with) requests, which is read from the environment variable MARE_WORKER_TOKEN */
+static String getToken()
+{
+  const char* token = getenv("MARE_WORKER_TOKEN");
+  return token ? String(token, -1) : String();
+}
+
+/** Compares a received token with the token of the worker in a time that does not depend on the position of the first difference */
+static bool isTokenValid(const String& token, const String& expectedToken)
+{
+  const char* data = token.getData();
+  const char* expectedData = expectedToken.getData();
+  size_t length = token.getLength(), expectedLength = expectedToken.getLength();
+  unsigned char difference = length != expectedLength;
+  for(size_t i = 0; i < expectedLength; ++i)
+    difference |= (unsigned char)(expectedData[i] ^ data[i < length ? i : 0]);
+  return difference == 0;
+}
+
+static bool isUnixAddress(const String& address)
+{
+  return strncmp(address.getData(), "unix:", 5) == 0;
+}
+
+/**
+* Opens a socket for an address
+* @param address "unix:<path>" for a Unix domain socket or "<host>:<port>" for a TCP socket (with an empty host for the loopback interface and "*" for all network interfaces)
+* @param server Whether to listen on the address instead of connecting to it
+* @return The file descriptor of the socket or \c -1 if an error occured
+*/
+static int openSocket(const String& address, bool server)
+{
+  if(isUnixAddress(address))
+  {
+    String path = address.substr(5);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.getLength() >= sizeof(addr.sun_path))
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    strcpy(addr.sun_path, path.getData());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd == -1)
+      return -1;
+    if(server)
+    {
+      unlink(addr.sun_path);
+      if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 && chmod(addr.sun_path, S_IRUSR | S_IWUSR) == 0 && listen(fd, 64) == 0)
+        return fd;
+    }
+    else if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+      return fd;
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  const char* data = address.getData();
+  const char* sep = strrchr(data, ':');
+  if(!sep)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  String host(data, sep - data);
+  bool anyHost = host == "*";
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if(server && anyHost)
+    hints.ai_flags = AI_PASSIVE;
+  struct addrinfo* result;
+  int err = getaddrinfo(host.isEmpty() || anyHost ? 0 : host.getData(), sep + 1, &hints, &result);
+  if(err != 0)
+  {
+    if(err != EAI_SYSTEM)
+      errno = EHOSTUNREACH;
+    return -1;
+  }
+  int fd = -1;
+  for(struct addrinfo* i = result; i; i = i->ai_next)
+  {
+    fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
+    if(fd == -1)
+      continue;
+    if(server)
+    {
+      int reuse = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+      if(bind(fd, i->ai_addr, i->ai_addrlen) == 0 && listen(fd, 64) == 0)
+        break;
+    }
+    else if(connect(fd, i->ai_addr, i->ai_addrlen) == 0)
+      break;
+    err = errno;
+    close(fd);
+    errno = err;
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  return fd;
+}
+
+/**
+* Returns the number of leading "../" of a path
+* @param path A relative path
+* @return The number of leading "../" or \c -1 if the path is absolute or leaves the directory tree otherwise
+*/
+static int getParentDepth(const String& path)
+{
+  if(File::isPathAbsolute(path))
+    return -1;
+  String simplePath = File::simplifyPath(path);
+  const char* data = simplePath.getData();
+  int depth = 0;
+  while(strncmp(data, "../", 3) == 0)
+  {
+    data += 3;
+    ++depth;
+  }
+  if(strcmp(data, "..") == 0 || strstr(data, "/../") || strncmp(data, "../", 3) == 0)
+    return -1;
+  return depth;
+}
+
+static int removeEntry(const char* path, const struct stat* st, int type, struct FTW* ftw)
+{
+  ::remove(path);
+  return 0;
+}
+
+/**
+* Executes the request of a client
+* @param fd The connection to the client
+* @param token The token that is required for the request
+* @return Whether the request was handled
+*/
+static bool serve(int fd, const String& token)
+{
+  // check the token before accepting anything else
+  unsigned int magic, count;
+  String requestToken;
+  if(!readUInt(fd, magic) || magic != protocolMagic || !readUInt(fd, count) || count > maxTokenLength)
+    return false;
+  if(count)
+  {
+    char* data = requestToken.getData(count);
+    if(!readAll(fd, data, count))
+      return false;
+    requestToken.setLength(count);
+  }
+  if(!token.isEmpty() && !isTokenValid(requestToken, token))
+  {
+    fprintf(stderr, "mare-worker: Rejected a request with an invalid token\n");
+    return false;
+  }
+
+  // receive the request
+  String command;
+  List<InputFile> inputs;
+  List<String> outputs;
+  if(!readString(fd, command) || !readUInt(fd, count))
+    return false;
+  int depth = 0;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    InputFile& input = inputs.append();
+    if(!readString(fd, input.path) || !readUInt(fd, input.permissions) || !readString(fd, input.content))
+      return false;
+    int inputDepth = getParentDepth(input.path);
+    if(inputDepth < 0)
+      return false;
+    if(inputDepth > depth)
+      depth = inputDepth;
+  }
+  if(!readUInt(fd, count))
+    return false;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    String& output = outputs.append();
+    if(!readString(fd, output))
+      return false;
+    int outputDepth = getParentDepth(output);
+    if(outputDepth < 0)
+      return false;
+    if(outputDepth > depth)
+      depth = outputDepth;
+  }
+
+  // create a working directory that is nested deep enough for the paths that start with "../"
+  const char* tmpDir = getenv("TMPDIR");
+  String pattern = String(tmpDir && *tmpDir ? tmpDir : "/tmp", -1) + "/mare-worker-XXXXXX";
+  String baseDir;
+  char* baseDirData = baseDir.getData(pattern.getLength());
+  memcpy(baseDirData, pattern.getData(), pattern.getLength() + 1);
+  if(!mkdtemp(baseDirData))
+  {
+    fprintf(stderr, "mare-worker: %s: %s\n", pattern.getData(), Error::getString().getData());
+    return false;
+  }
+  baseDir.setLength(pattern.getLength());
+  String workDir = baseDir;
+  for(int i = 0; i < depth; ++i)
+    workDir.append("/_");
+  Directory::create(workDir);
+
+  unsigned int exitCode = submitFailure; // until the command was executed
+  String output;
+  String reply;
+  if(!Directory::change(workDir))
+    output = workDir + ": " + Error::getString() + "\n";
+  else
+  {
+    for(const List<InputFile>::Node* i = inputs.getFirst(); i; i = i->getNext())
+      if(!writeFile(i->data.path, i->data.content, i->data.permissions))
+        output.append(i->data.path + ": " + Error::getString() + "\n");
+    for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+      Directory::create(File::getDirname(i->data));
+
+    // run the command
+    if(output.isEmpty())
+    {
+      Process process;
+      unsigned int pid = process.start(command);
+      if(!pid)
+        output = Error::getString() + "\n";
+      else
+      {
+        while(Process::waitOne() != pid);
+        exitCode = process.join();
+        output = process.getOutput();
+      }
+    }
+  }
+
+  // send the reply
+  appendUInt(reply, exitCode);
+  appendString(reply, output);
+  appendUInt(reply, (unsigned int)outputs.getSize());
+  for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+  {
+    unsigned int permissions = 0;
+    String content;
+    bool exists = exitCode == 0 && File::getPermissions(i->data, permissions) && readFile(i->data, content);
+    appendUInt(reply, exists ? 1 : 0);
+    appendUInt(reply, permissions);
+    appendString(reply, content);
+  }
+  bool result = writeAll(fd, reply.getData(), reply.getLength());
+
+  Directory::change("/");
+  nftw(baseDir.getData(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+  return result;
+}
+
+/**
+* Accepts connections from clients and handles each connection in a forked process
+* @param address The address to listen on
+* @return An exit code
+*/
+static int listenOn(const String& address)
+{
+  String token = getToken();
+  if(token.isEmpty() && !isUnixAddress(address))
+  {
+    fprintf(stderr, "mare-worker: %s: Listening on a TCP address requires a token (MARE_WORKER_TOKEN)\n", address.getData());
+    return EXIT_FAILURE;
+  }
+  int socketFd = openSocket(address, true);
+  if(socketFd == -1)
+  {
+    fprintf(stderr, "mare-worker: %s: %s\n", address.getData(), Error::getString().getData());
+    return EXIT_FAILURE;
+  }
+  signal(SIGCHLD, SIG_IGN); // there is no need to wait for the forked processes
+  signal(SIGPIPE, SIG_IGN);
+  printf("mare-worker: Listening on %s\n", address.getData());
+  fflush(stdout);
+
+  for(;;)
+  {
+    int fd = accept(socketFd, 0, 0);
+    if(fd == -1)
+    {
+      if(errno == EINTR || errno == ECONNABORTED)
+        continue;
+      fprintf(stderr, "mare-worker: %s\n", Error::getString().getData());
+      return EXIT_FAILURE;
+    }
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+      close(socketFd);
+      signal(SIGCHLD, SIG_DFL);
+      _exit(serve(fd, token) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if(pid == -1)
+      fprintf(stderr, "mare-worker: %s\n", Error::getString().getData());
+    close(fd);
+  }
+}
+
+/**
+* Sends a request to a worker and writes the output files that were received
+* @param address The address of the worker
+* @param requestFile A file that lists the command ("command <command>"), the input files ("input <file>") and the output files ("output <file>") line by line
+* @return The exit code of the command or \c submitFailure if the worker could not execute the command
+*/
+static int submit(const String& address, const String& requestFile)
+{
+  String data;
+  if(!readFile(requestFile, data))
+  {
+    fprintf(stderr, "mare-worker: %s: %s\n", requestFile.getData(), Error::getString().getData());
+    return submitFailure;
+  }
+
+  // read the request file
+  String command;
+  List<String> inputs, outputs;
+  for(const char* line = data.getData(), * end; *line; line = *end ? end + 1 : end)
+  {
+    end = strchr(line, '\n');
+    if(!end)
+      end = line + strlen(line);
+    const char* sep = (const char*)memchr(line, ' ', end - line);
+    if(!sep)
+      continue;
+    String key(line, sep - line);
+    String value(sep + 1, end - (sep + 1));
+    if(key == "command")
+      command = value;
+    else if(key == "input")
+      inputs.append(value);
+    else if(key == "output")
+      outputs.append(value);
+  }
+
+  // compose the request (files outside of the working directory are expected to exist on the worker)
+  String request;
+  appendUInt(request, protocolMagic);
+  appendString(request, getToken());
+  appendString(request, command);
+  List<InputFile> inputFiles;
+  for(const List<String>::Node* i = inputs.getFirst(); i; i = i->getNext())
+  {
+    if(getParentDepth(i->data) < 0)
+      continue;
+    InputFile input;
+    if(!File::getPermissions(i->data, input.permissions) || !readFile(i->data, input.content))
+    {
+      fprintf(stderr, "mare-worker: %s: %s\n", i->data.getData(), Error::getString().getData());
+      return submitFailure; // the command might not need the file anymore
+    }
+    input.path = i->data;
+    inputFiles.append(input);
+  }
+  appendUInt(request, (unsigned int)inputFiles.getSize());
+  for(const List<InputFile>::Node* i = inputFiles.getFirst(); i; i = i->getNext())
+  {
+    appendString(request, i->data.path);
+    appendUInt(request, i->data.permissions);
+    appendString(request, i->data.content);
+  }
+  appendUInt(request, (unsigned int)outputs.getSize());
+  for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+    appendString(request, i->data);
+
+  // execute the request
+  signal(SIGPIPE, SIG_IGN);
+  int fd = openSocket(address, false);
+  if(fd == -1)
+  {
+    fprintf(stderr, "mare-worker: %s: %s\n", address.getData(), Error::getString().getData());
+    return submitFailure;
+  }
+  unsigned int exitCode, count;
+  String output;
+  if(!writeAll(fd, request.getData(), request.getLength()) || !readUInt(fd, exitCode) || !readString(fd, output) ||
+     !readUInt(fd, count) || count != outputs.getSize())
+  {
+    fprintf(stderr, "mare-worker: %s: The connection to the worker was lost\n", address.getData());
+    close(fd);
+    return submitFailure;
+  }
+  for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+  {
+    unsigned int exists, permissions;
+    String content;
+    if(!readUInt(fd, exists) || !readUInt(fd, permissions) || !readString(fd, content))
+    {
+      fprintf(stderr, "mare-worker: %s: The connection to the worker was lost\n", address.getData());
+      close(fd);
+      return submitFailure;
+    }
+    if(!exists)
+      File::unlink(i->data);
+    else if(!writeFile(i->data, content, permissions))
+    {
+      fprintf(stderr, "mare-worker: %s: %s\n", i->data.getData(), Error::getString().getData());
+      exitCode = submitFailure;
+    }
+  }
+  close(fd);
+
+  // a command that failed since it lacked a file on the worker (e.g. a header that was not included by the previous
+  // version of a source file and is therefore not listed in its dependency file) is executed locally instead
+  size_t pos;
+  if(exitCode != 0 && exitCode != (unsigned int)submitFailure && (output.find("No such file or directory", pos) || output.find("file not found", pos)))
+  {
+    fprintf(stderr, "mare-worker: %s: The command lacked a file on the worker\n", address.getData());
+    return submitFailure;
+  }
+  fwrite(output.getData(), 1, output.getLength(), stdout);
+  return exitCode;
+}
+#endif
+
+static void showUsage(const char* executable)
+{
+  String basename = File::getBasename(String(executable, -1));
+  printf("Usage: %s --listen=<address>\n", basename.getData());
+  printf("       %s --submit=<address> <file>\n", basename.getData());
+  puts("");
+  puts("Executes commands of mare on behalf of other hosts.");
+  puts("");
+  puts("Options:");
+  puts("");
+  puts("    --listen=<address>");
+  puts("        Execute the commands that are sent to <address>. <address> is either");
+  puts("        unix:<path> for a Unix domain socket or <host>:<port> for a TCP socket");
+  puts("        (e.g. :7000 for the loopback interface, myhost:7000 for the interface");
+  puts("        of myhost or *:7000 for all network interfaces).");
+  puts("");
+  puts("    --submit=<address> <file>");
+  puts("        Send the request described in <file> to the worker at <address> and");
+  puts("        write the output files that were received. (used by mare) Exits with");
+  puts("        125 if the worker could not execute the command (e.g. since it could");
+  puts("        not be reached or lacked an input file).");
+  puts("");
+  puts("    -h, --help");
+  puts("        Display this help message.");
+  puts("");
+  puts("Security:");
+  puts("");
+  puts("    The worker executes any command it receives with the permissions of its");
+  puts("    user. Requests are therefore only accepted with the token given in the");
+  puts("    environment variable MARE_WORKER_TOKEN, which has to be set for both the");
+  puts("    worker and mare. A token is required for TCP sockets and optional for");
+  puts("    Unix domain sockets, which are only accessible by the user of the worker.");
+  puts("    The token and the files are sent unencrypted, so a TCP socket should only");
+  puts("    be used in a trusted network (or through an SSH tunnel).");
+  puts("");
+  exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef _WIN32
+  fprintf(stderr, "%s: The worker is not supported on this platform\n", argv[0]);
+  return EXIT_FAILURE;
+#else
+  String listenAddress, submitAddress;
+  static struct option long_options[] = {
+    {"listen", required_argument , 0, 'l'},
+    {"submit", required_argument , 0, 's'},
+    {"help", no_argument , 0, 'h'},
+    {0, 0, 0, 0}
+  };
+  int c, option_index;
+  while((c = getopt_long(argc, argv, "h", long_options, &option_index)) != -1)
+    switch(c)
+    {
+    case 'l':
+      listenAddress = String(optarg, -1);
+      break;
+    case 's':
+      submitAddress = String(optarg, -1);
+      break;
+    case 'h':
+      showUsage(argv[0]);
+      break;
+    default:
+      fprintf(stderr, "Type '%s --help' for help\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if(!listenAddress.isEmpty() && submitAddress.isEmpty() && optind == argc)
+    return listenOn(listenAddress);
+  if(!submitAddress.isEmpty() && listenAddress.isEmpty() && optind + 1 == argc)
+    return submit(submitAddress, String(argv[optind], -1));
+  fprintf(stderr, "Type '%s --help' for help\n", argv[0]);
+  return EXIT_FAILURE;
+#endif
+}
@@ -0,0 +1,487 @@
+
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Tools/Assert.h"
+#include "Tools/Directory.h"
+#include "Tools/Hash.h"
+
+#include "BuildState.h"
+
+static const char stateFileHeader[] = "# mare state v2\n";
+static const size_t stateFileHeaderLength = sizeof(stateFileHeader) - 1;
+static const size_t recordHeaderLength = sizeof(unsigned int) * 2;
+static const size_t depsHeaderLength = sizeof(long long) + sizeof(unsigned int);
+
+BuildState::~BuildState()
+{
+  close();
+}
+
+void BuildState::load(const String& file)
+{
+  ASSERT(path.isEmpty());
+  path = file;
+
+  // map the state file into memory
+  const char* data = 0;
+  size_t size = 0;
+#ifdef _WIN32
+  HANDLE hFile = CreateFileA(file.getData(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(hFile == INVALID_HANDLE_VALUE)
+    return;
+  size = GetFileSize(hFile, NULL);
+  HANDLE hMapping = size > 0 ? CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  CloseHandle(hFile);
+  if(!hMapping)
+  {
+    rewrite = true;
+    return;
+  }
+  data = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(hMapping);
+  if(!data)
+  {
+    rewrite = true;
+    return;
+  }
+#else
+  int fd = open(file.getData(), O_RDONLY);
+  if(fd == -1)
+    return;
+  struct stat buf;
+  if(fstat(fd, &buf) != 0 || buf.st_size <= 0)
+  {
+    ::close(fd);
+    rewrite = true;
+    return;
+  }
+  size = (size_t)buf.st_size;
+  void* mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if(mapping == MAP_FAILED)
+  {
+    rewrite = true;
+    return;
+  }
+  data = (const char*)mapping;
+#endif
+
+  // read records
+  const char* pos = data;
+  const char* end = data + size;
+  if(size < stateFileHeaderLength || memcmp(data, stateFileHeader, stateFileHeaderLength) != 0)
+    pos = end; // unknown format or version
+  else
+    pos += stateFileHeaderLength;
+  while((size_t)(end - pos) >= recordHeaderLength)
+  {
+    unsigned int type, length;
+    memcpy(&type, pos, sizeof(type));
+    memcpy(&length, pos + sizeof(type), sizeof(length));
+    size_t dataSize;
+    switch(type)
+    {
+    case entryRecord:
+      dataSize = sizeof(Entry);
+      break;
+    case fingerprintRecord:
+      dataSize = sizeof(Fingerprint);
+      break;
+    case durationRecord:
+      dataSize = sizeof(long long);
+      break;
+    case peakMemoryRecord:
+      dataSize = sizeof(unsigned long long);
+      break;
+    case pathRecord:
+      dataSize = sizeof(unsigned int);
+      break;
+    case depsRecord:
+      {
+        unsigned int count = 0;
+        if((size_t)(end - pos) - recordHeaderLength >= depsHeaderLength)
+          memcpy(&count, pos + recordHeaderLength + sizeof(long long), sizeof(count));
+        dataSize = depsHeaderLength + (size_t)count * sizeof(unsigned int);
+      }
+      break;
+    default:
+      goto unknownRecord;
+    }
+    if((size_t)(end - pos) - recordHeaderLength < dataSize + length)
+      break;
+    {
+      const char* data = pos + recordHeaderLength;
+      String key(data + dataSize, length);
+      if(type == entryRecord)
+      {
+        Map<String, Entry>::Node* node = entries.find(key);
+        memcpy(node ? &node->data : &entries.append(key), data, dataSize);
+      }
+      else if(type == fingerprintRecord)
+      {
+        Map<String, Fingerprint>::Node* node = fingerprints.find(key);
+        memcpy(node ? &node->data : &fingerprints.append(key), data, dataSize);
+      }
+      else if(type == durationRecord)
+      {
+        Map<String, long long>::Node* node = durations.find(key);
+        memcpy(node ? &node->data : &durations.append(key), data, dataSize);
+      }
+      else if(type == peakMemoryRecord)
+      {
+        Map<String, unsigned long long>::Node* node = peakMemories.find(key);
+        memcpy(node ? &node->data : &peakMemories.append(key), data, dataSize);
+      }
+      else if(type == pathRecord)
+      {
+        unsigned int id;
+        memcpy(&id, data, sizeof(id));
+        if(id > paths.getSize())
+          break; // path ids are assigned in sequence, so the file is damaged
+        if(id == paths.getSize())
+          paths.setSize(id + 1);
+        paths.getFirst()[id] = key;
+        Map<String, unsigned int>::Node* node = pathIds.find(key);
+        (node ? node->data : pathIds.append(key)) = id;
+      }
+      else
+      {
+        Map<String, String>::Node* node = deps.find(key);
+        (node ? node->data : deps.append(key)) = String(data, dataSize);
+      }
+    }
+    ++recordCount;
+    pos += recordHeaderLength + dataSize + length;
+  }
+unknownRecord:
+  if(pos != end)
+    rewrite = true; // the file is damaged or uses an unknown format
+
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap((void*)data, size);
+#endif
+}
+
+const BuildState::Entry* BuildState::find(const String& output) const
+{
+  const Map<String, Entry>::Node* node = entries.find(output);
+  return node ? &node->data : 0;
+}
+
+void BuildState::record(const String& output, unsigned long long commandHash, long long writeTime, unsigned long long inputsHash)
+{
+  Map<String, Entry>::Node* node = entries.find(output);
+  Entry& entry = node ? node->data : entries.append(output);
+  entry.commandHash = commandHash;
+  entry.writeTime = writeTime;
+  entry.inputsHash = inputsHash;
+  append(entryRecord, output, &entry, sizeof(entry));
+}
+
+bool BuildState::getContentTime(const String& file, long long& contentTime)
+{
+  const Fingerprint* fingerprint = getFingerprint(file);
+  if(!fingerprint)
+    return false;
+  contentTime = fingerprint->contentTime;
+  return true;
+}
+
+bool BuildState::getContentHash(const String& file, unsigned long long& contentHash, bool reread)
+{
+  const Fingerprint* fingerprint = getFingerprint(file, reread);
+  if(!fingerprint)
+    return false;
+  contentHash = fingerprint->contentHash;
+  return true;
+}
+
+const BuildState::Fingerprint* BuildState::getFingerprint(const String& file, bool reread)
+{
+  File::Status status;
+  if(!File::getStatus(file, status))
+    return 0;
+  Map<String, Fingerprint>::Node* node = fingerprints.find(file);
+  if(node && !reread && node->data.writeTime == status.writeTime && node->data.size == status.size && node->data.id == status.id)
+    return &node->data;
+
+  // compute the content hash
+  Hash hash;
+  {
+    File contentFile;
+    if(!contentFile.open(file))
+      return 0;
+    char buffer[16384];
+    size_t i;
+    while((i = contentFile.read(buffer, sizeof(buffer))) > 0)
+      hash.append(buffer, i);
+  }
+
+  Fingerprint& fingerprint = node ? node->data : fingerprints.append(file);
+  if(!node || fingerprint.contentHash != hash.get())
+    fingerprint.contentTime = status.writeTime;
+  fingerprint.writeTime = status.writeTime;
+  fingerprint.size = status.size;
+  fingerprint.id = status.id;
+  fingerprint.contentHash = hash.get();
+  append(fingerprintRecord, file, &fingerprint, sizeof(fingerprint));
+  return &fingerprint;
+}
+
+long long BuildState::getDuration(const String& output) const
+{
+  const Map<String, long long>::Node* node = durations.find(output);
+  return node ? node->data : 0;
+}
+
+void BuildState::recordDuration(const String& output, long long duration)
+{
+  Map<String, long long>::Node* node = durations.find(output);
+  long long& data = node ? node->data : durations.append(output);
+  data = duration;
+  append(durationRecord, output, &data, sizeof(data));
+}
+
+unsigned long long BuildState::getPeakMemory(const String& output) const
+{
+  const Map<String, unsigned long long>::Node* node = peakMemories.find(output);
+  return node ? node->data : 0;
+}
+
+void BuildState::recordPeakMemory(const String& output, unsigned long long peakMemory)
+{
+  Map<String, unsigned long long>::Node* node = peakMemories.find(output);
+  unsigned long long& data = node ? node->data : peakMemories.append(output);
+  data = peakMemory;
+  append(peakMemoryRecord, output, &data, sizeof(data));
+}
+
+bool BuildState::getDeps(const String& depfile, List<String>& prerequisites)
+{
+  const Map<String, String>::Node* node = deps.find(depfile);
+  if(!node)
+  {
+    if(!recordDeps(depfile))
+      return false;
+    node = deps.getLast();
+  }
+  const char* data = node->data.getData();
+  unsigned int count;
+  memcpy(&count, data + sizeof(long long), sizeof(count));
+  const char* ids = data + depsHeaderLength;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    unsigned int id;
+    memcpy(&id, ids + i * sizeof(id), sizeof(id));
+    if(id < paths.getSize())
+      prerequisites.append(paths.getFirst()[id]);
+  }
+  return true;
+}
+
+long long BuildState::getDepsWriteTime(const String& depfile) const
+{
+  const Map<String, String>::Node* node = deps.find(depfile);
+  if(!node)
+    return 0;
+  long long writeTime;
+  memcpy(&writeTime, node->data.getData(), sizeof(writeTime));
+  return writeTime;
+}
+
+bool BuildState::recordDeps(const String& depfile)
+{
+  long long writeTime;
+  List<String> prerequisites;
+  if(!File::getWriteTime(depfile, writeTime) || !readDepfile(depfile, prerequisites))
+    return false;
+  unsigned int count = prerequisites.getSize();
+  String data(depsHeaderLength + count * sizeof(unsigned int));
+  data.append((const char*)&writeTime, sizeof(writeTime));
+  data.append((const char*)&count, sizeof(count));
+  for(const List<String>::Node* i = prerequisites.getFirst(); i; i = i->getNext())
+  {
+    unsigned int id = getPathId(i->data);
+    data.append((const char*)&id, sizeof(id));
+  }
+  Map<String, String>::Node* node = deps.find(depfile);
+  (node ? node->data : deps.append(depfile)) = data;
+  append(depsRecord, depfile, data.getData(), data.getLength());
+  return true;
+}
+
+bool BuildState::readDepfile(const String& file, List<String>& prerequisites)
+{
+  String data;
+  {
+    File depfile;
+    if(!depfile.open(file))
+      return false;
+    char buffer[16384];
+    size_t i;
+    while((i = depfile.read(buffer, sizeof(buffer))) > 0)
+      data.append(buffer, i);
+  }
+  String word;
+  for(const char* str = data.getData();; ++str)
+  {
+    switch(*str)
+    {
+    case '\\':
+      if(str[1] == '\n' || (str[1] == '\r' && str[2] == '\n'))
+      {
+        str += str[1] == '\r' ? 2 : 1;
+        goto endOfWord;
+      }
+      if(str[1] == ' ' || str[1] == '#')
+        ++str;
+      word.append(*str);
+      continue;
+    case '$':
+      if(str[1] == '$')
+        ++str;
+      word.append(*str);
+      continue;
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+    case '\0':
+      goto endOfWord;
+    default:
+      word.append(*str);
+      continue;
+    }
+  endOfWord:
+    if(!word.isEmpty())
+    {
+      if(word.getData()[word.getLength() - 1] != ':') // skip targets
+        prerequisites.append(word);
+      word.clear();
+    }
+    if(!*str)
+      break;
+  }
+  return true;
+}
+
+unsigned int BuildState::getPathId(const String& path)
+{
+  Map<String, unsigned int>::Node* node = pathIds.find(path);
+  if(node)
+    return node->data;
+  unsigned int id = (unsigned int)paths.getSize();
+  paths.append(path);
+  pathIds.append(path, id);
+  append(pathRecord, path, &id, sizeof(id));
+  return id;
+}
+
+void BuildState::clear()
+{
+  file.close();
+  File::unlink(path);
+  entries.clear();
+  fingerprints.clear();
+  deps.clear();
+  paths.clear();
+  pathIds.clear();
+  rewrite = true;
+}
+
+void BuildState::close()
+{
+  file.close();
+
+  // compact the state file if it contains too many outdated records
+  if(recordCount > 100 && recordCount > getLiveRecordCount() * 3)
+  {
+    String tmpPath = path;
+    tmpPath.append(".tmp");
+    File tmpFile;
+    if(tmpFile.open(tmpPath, File::writeFlag))
+    {
+      if(!writeAll(tmpFile))
+      {
+        tmpFile.close();
+        File::unlink(tmpPath);
+        return;
+      }
+      tmpFile.close();
+      if(File::rename(tmpPath, path))
+        recordCount = getLiveRecordCount();
+    }
+  }
+}
+
+void BuildState::append(RecordType type, const String& key, const void* data, size_t size)
+{
+  if(rewrite || recordCount == 0)
+  {
+    // start a new state file with all known entries
+    file.close();
+    Directory::create(File::getDirname(path));
+    if(!file.open(path, File::writeFlag))
+      return;
+    if(writeAll(file))
+      recordCount = getLiveRecordCount();
+    rewrite = false;
+    return;
+  }
+
+  if(!file.isOpen() && !file.open(path, File::appendFlag))
+    return;
+  if(writeRecord(file, type, key, data, size))
+    ++recordCount;
+}
+
+bool BuildState::writeAll(File& file)
+{
+  if(file.write(stateFileHeader, stateFileHeaderLength) != stateFileHeaderLength)
+    return false;
+  for(const Map<String, Entry>::Node* i = entries.getFirst(); i; i = i->getNext())
+    if(!writeRecord(file, entryRecord, i->key, &i->data, sizeof(i->data)))
+      return false;
+  for(const Map<String, Fingerprint>::Node* i = fingerprints.getFirst(); i; i = i->getNext())
+    if(!writeRecord(file, fingerprintRecord, i->key, &i->data, sizeof(i->data)))
+      return false;
+  for(const Map<String, long long>::Node* i = durations.getFirst(); i; i = i->getNext())
+    if(!writeRecord(file, durationRecord, i->key, &i->data, sizeof(i->data)))
+      return false;
+  for(const Map<String, unsigned long long>::Node* i = peakMemories.getFirst(); i; i = i->getNext())
+    if(!writeRecord(file, peakMemoryRecord, i->key, &i->data, sizeof(i->data)))
+      return false;
+  for(unsigned int i = 0; i < paths.getSize(); ++i)
+    if(!writeRecord(file, pathRecord, paths.getFirst()[i], &i, sizeof(i)))
+      return false;
+  for(const Map<String, String>::Node* i = deps.getFirst(); i; i = i->getNext())
+    if(!writeRecord(file, depsRecord, i->key, i->data.getData(), i->data.getLength()))
+      return false;
+  return true;
+}
+
+unsigned int BuildState::getLiveRecordCount() const
+{
+  return entries.getSize() + fingerprints.getSize() + durations.getSize() + peakMemories.getSize() + paths.getSize() + deps.getSize();
+}
+
+bool BuildState::writeRecord(File& file, RecordType type, const String& key, const void* data, size_t size)
+{
+  char header[recordHeaderLength];
+  unsigned int recordType = type;
+  unsigned int length = (unsigned int)key.getLength();
+  memcpy(header, &recordType, sizeof(recordType));
+  memcpy(header + sizeof(recordType), &length, sizeof(length));
+  return file.write(header, recordHeaderLength) == recordHeaderLength && file.write((const char*)data, size) == size && file.write(key);
+}
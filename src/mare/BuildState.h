@@ -0,0 +1,158 @@
+
+#pragma once
+
+#include "Tools/Array.h"
+#include "Tools/List.h"
+#include "Tools/Map.h"
+#include "Tools/String.h"
+#include "Tools/File.h"
+
+/**
+* A per build directory database that remembers the state of each output file since the last run.
+* The database is stored as an append-only log, which is compacted when it contains too many outdated records.
+*/
+class BuildState
+{
+public:
+  class Entry
+  {
+  public:
+    unsigned long long commandHash; /**< A hash of the command lines used to create the output file */
+    long long writeTime; /**< The modification time of the output file when the entry was recorded */
+    unsigned long long inputsHash; /**< A hash of the input file names and modification times or \c 0 if unknown */
+  };
+
+  /** The content fingerprint of a file that is cached along with the file's status */
+  class Fingerprint
+  {
+  public:
+    long long writeTime;
+    long long size;
+    unsigned long long id;
+    unsigned long long contentHash;
+    long long contentTime; /**< The modification time of the file when its content was changed */
+  };
+
+  BuildState() : recordCount(0), rewrite(false) {}
+
+  ~BuildState();
+
+  /**
+  * Loads the records of a state file
+  * @param file The path to the state file
+  */
+  void load(const String& file);
+
+  const Entry* find(const String& output) const;
+
+  /**
+  * Updates (or adds) the entry of an output file and appends it to the state file
+  */
+  void record(const String& output, unsigned long long commandHash, long long writeTime, unsigned long long inputsHash);
+
+  /**
+  * Determines the modification time of the last change of the content of a file. Files that were touched without
+  * changing their content retain their previous content time. The content of a file is only read when its status
+  * has changed since its content fingerprint was recorded.
+  * @param file The path to the file
+  * @param contentTime The content time
+  * @return Whether the file could be read
+  */
+  bool getContentTime(const String& file, long long& contentTime);
+
+  /**
+  * Determines the content hash of a file using the cached content fingerprint if the file's status has not changed
+  * @param file The path to the file
+  * @param contentHash The content hash
+  * @param reread Whether the content should be read even if the file's status has not changed (e.g. because the file was just written within the resolution of the file system's timestamps)
+  * @return Whether the file could be read
+  */
+  bool getContentHash(const String& file, unsigned long long& contentHash, bool reread = false);
+
+  /**
+  * Returns the time that was needed to execute the commands for creating an output file the last time
+  * @param output The (first) output file of a rule
+  * @return The duration in microseconds or \c 0 if unknown
+  */
+  long long getDuration(const String& output) const;
+
+  /** Updates (or adds) the execution time of the commands for creating an output file */
+  void recordDuration(const String& output, long long duration);
+
+  /**
+  * Returns the peak memory usage of the commands for creating an output file the last time
+  * @param output The (first) output file of a rule
+  * @return The peak memory usage in bytes or \c 0 if unknown
+  */
+  unsigned long long getPeakMemory(const String& output) const;
+
+  /** Updates (or adds) the peak memory usage of the commands for creating an output file */
+  void recordPeakMemory(const String& output, unsigned long long peakMemory);
+
+  /**
+  * Adds the prerequisites that were recorded for a dependency file to a list. The dependency file is parsed and
+  * recorded if it was not recorded before.
+  * @param depfile The path to the dependency file
+  * @param prerequisites The list to which the prerequisites are added
+  * @return Whether prerequisites were recorded for the dependency file
+  */
+  bool getDeps(const String& depfile, List<String>& prerequisites);
+
+  /**
+  * Returns the modification time of a dependency file when its prerequisites were recorded
+  * @param depfile The path to the dependency file
+  * @return The modification time or \c 0 if the dependency file was not recorded
+  */
+  long long getDepsWriteTime(const String& depfile) const;
+
+  /**
+  * Parses a dependency file (that was just written by a command) and records its prerequisites
+  * @param depfile The path to the dependency file
+  * @return Whether the dependency file could be read
+  */
+  bool recordDeps(const String& depfile);
+
+  /**
+  * Parses a Makefile-style dependency file (as written by "gcc -MMD")
+  * @param file The path to the dependency file
+  * @param prerequisites The list to which the prerequisites are added
+  * @return Whether the file could be read
+  */
+  static bool readDepfile(const String& file, List<String>& prerequisites);
+
+  /** Deletes the state file and forgets the state of all output files. Only the execution times and memory usages are kept. */
+  void clear();
+
+  /** Closes the state file and compacts it if necessary */
+  void close();
+
+private:
+  enum RecordType
+  {
+    entryRecord = 1,
+    fingerprintRecord = 2,
+    durationRecord = 3,
+    peakMemoryRecord = 4,
+    pathRecord = 5,
+    depsRecord = 6,
+  };
+
+  String path;
+  Map<String, Entry> entries;
+  Map<String, Fingerprint> fingerprints;
+  Map<String, long long> durations;
+  Map<String, unsigned long long> peakMemories;
+  Map<String, String> deps; /**< The recorded prerequisites of each dependency file (the modification time of the dependency file, the number of prerequisites and their path ids) */
+  Array<String> paths; /**< The paths of the prerequisites of the dependency files by path id */
+  Map<String, unsigned int> pathIds;
+  unsigned int recordCount;
+  bool rewrite;
+  File file;
+
+  const Fingerprint* getFingerprint(const String& file, bool reread = false);
+  unsigned int getPathId(const String& path);
+  unsigned int getLiveRecordCount() const;
+  void append(RecordType type, const String& key, const void* data, size_t size);
+  bool writeAll(File& file);
+  static bool writeRecord(File& file, RecordType type, const String& key, const void* data, size_t size);
+};
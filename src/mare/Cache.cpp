@@ -0,0 +1,332 @@
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Tools/Directory.h"
+#include "Tools/File.h"
+#include "Tools/Hash.h"
+#include "Tools/Process.h"
+#include "Tools/Word.h"
+
+#include "BuildState.h"
+#include "Cache.h"
+
+static const char entryFileHeader[] = "# mare cache v1\n";
+static const size_t entryFileHeaderLength = sizeof(entryFileHeader) - 1;
+
+static bool readFile(const String& path, String& data)
+{
+  File file;
+  if(!file.open(path))
+    return false;
+  char buffer[16384];
+  size_t i;
+  while((i = file.read(buffer, sizeof(buffer))) > 0)
+    data.append(buffer, i);
+  return true;
+}
+
+/** A helper for reading the fields of a cache entry */
+class EntryReader
+{
+public:
+  EntryReader(const String& data) : pos(data.getData()), end(data.getData() + data.getLength()) {}
+
+  bool read(void* buffer, size_t size)
+  {
+    if((size_t)(end - pos) < size)
+      return false;
+    memcpy(buffer, pos, size);
+    pos += size;
+    return true;
+  }
+
+  bool read(String& str)
+  {
+    unsigned int length;
+    if(!read(&length, sizeof(length)) || (size_t)(end - pos) < length)
+      return false;
+    str = String(pos, length);
+    pos += length;
+    return true;
+  }
+
+  const char* pos;
+  const char* end;
+};
+
+/** A cache entry file that is considered for removal */
+class EntryFile
+{
+public:
+  String path;
+  long long writeTime;
+  long long size;
+
+  static int compare(const EntryFile& a, const EntryFile& b)
+  {
+    return a.writeTime < b.writeTime ? -1 : a.writeTime > b.writeTime ? 1 : 0;
+  }
+};
+
+static bool writeString(File& file, const String& str)
+{
+  unsigned int length = (unsigned int)str.getLength();
+  return file.write((const char*)&length, sizeof(length)) == sizeof(length) && file.write(str.getData(), length) == length;
+}
+
+Cache::Cache(const String& dir, unsigned long long maxSize) : dir(dir), maxSize(maxSize), size(0), hits(0), misses(0)
+{
+  String stats;
+  if(readFile(dir + "/stats", stats))
+  {
+    unsigned int totalHits, totalMisses;
+    sscanf(stats.getData(), "hits %u\nmisses %u\nsize %llu\n", &totalHits, &totalMisses, &size);
+  }
+}
+
+Cache::~Cache()
+{
+  bool evicted = size > maxSize;
+  if(evicted)
+    evict();
+  if(hits == 0 && misses == 0 && !evicted)
+    return;
+
+  // update the statistics
+  String statsFile = dir + "/stats";
+  String stats;
+  unsigned int totalHits = 0, totalMisses = 0;
+  unsigned long long oldSize = 0;
+  if(readFile(statsFile, stats))
+    sscanf(stats.getData(), "hits %u\nmisses %u\nsize %llu\n", &totalHits, &totalMisses, &oldSize);
+  stats.format(128, "hits %u\nmisses %u\nsize %llu\n", totalHits + hits, totalMisses + misses, size);
+  Directory::create(dir);
+  File file;
+  if(file.open(statsFile, File::writeFlag))
+    file.write(stats);
+}
+
+unsigned long long Cache::getKey(const List<String>& command, const List<String>& inputs, const List<String>& outputs, BuildState& buildState)
+{
+  Hash hash;
+  for(const List<String>::Node* i = command.getFirst(); i; i = i->getNext())
+  {
+    hash.append(i->data);
+    hash.append((long long)getProgramFingerprint(i->data));
+  }
+  for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+    hash.append(i->data);
+  for(const List<String>::Node* i = inputs.getFirst(); i; i = i->getNext())
+  {
+    unsigned long long contentHash;
+    if(!buildState.getContentHash(i->data, contentHash))
+      return 0;
+    hash.append(i->data);
+    hash.append((long long)contentHash);
+  }
+  return hash.get() ? hash.get() : 1;
+}
+
+bool Cache::restore(unsigned long long key, const List<String>& outputs, BuildState& buildState, String& output)
+{
+  String entryFile = getEntryPath(key);
+  String data;
+  if(!readFile(entryFile, data) || data.getLength() < entryFileHeaderLength || memcmp(data.getData(), entryFileHeader, entryFileHeaderLength) != 0)
+    goto miss;
+  {
+    EntryReader reader(data);
+    reader.pos += entryFileHeaderLength;
+
+    // check the content of the prerequisites
+    unsigned int count;
+    if(!reader.read(&count, sizeof(count)))
+      goto miss;
+    for(unsigned int i = 0; i < count; ++i)
+    {
+      unsigned long long recordedHash, contentHash;
+      String file;
+      if(!reader.read(&recordedHash, sizeof(recordedHash)) || !reader.read(file))
+        goto miss;
+      if(!buildState.getContentHash(file, contentHash) || contentHash != recordedHash)
+        goto miss;
+    }
+
+    // restore the output files
+    String entryOutput;
+    if(!reader.read(entryOutput) || !reader.read(&count, sizeof(count)) || count != outputs.getSize())
+      goto miss;
+    for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+    {
+      unsigned int permissions;
+      String content;
+      if(!reader.read(&permissions, sizeof(permissions)) || !reader.read(content))
+        goto miss;
+      String tmpFile = i->data + ".tmp";
+      File file;
+      if(!file.open(tmpFile, File::writeFlag))
+        goto miss;
+      if(file.write(content.getData(), content.getLength()) != content.getLength())
+      {
+        file.close();
+        File::unlink(tmpFile);
+        goto miss;
+      }
+      file.close();
+      if(!File::setPermissions(tmpFile, permissions) || !File::rename(tmpFile, i->data))
+      {
+        File::unlink(tmpFile);
+        goto miss;
+      }
+    }
+
+    File::touch(entryFile); // mark the entry as recently used
+    output = entryOutput;
+    ++hits;
+    return true;
+  }
+
+miss:
+  ++misses;
+  return false;
+}
+
+void Cache::store(unsigned long long key, const List<String>& outputs, const String& depfile, const String& output, BuildState& buildState)
+{
+  // collect the prerequisites from the dependency file
+  List<String> prerequisites;
+  if(!depfile.isEmpty() && !BuildState::readDepfile(depfile, prerequisites))
+    return;
+
+  String entryFile = getEntryPath(key);
+#ifdef _WIN32
+  String tmpFile = entryFile + String().format(32, ".%u.tmp", (unsigned int)GetCurrentProcessId());
+#else
+  String tmpFile = entryFile + String().format(32, ".%u.tmp", (unsigned int)getpid());
+#endif
+  Directory::create(File::getDirname(entryFile));
+  File file;
+  if(!file.open(tmpFile, File::writeFlag))
+    return;
+  if(file.write(entryFileHeader, entryFileHeaderLength) != entryFileHeaderLength)
+    goto error;
+  {
+    unsigned long long entrySize = entryFileHeaderLength;
+    unsigned int count = prerequisites.getSize();
+    if(file.write((const char*)&count, sizeof(count)) != sizeof(count))
+      goto error;
+    for(const List<String>::Node* i = prerequisites.getFirst(); i; i = i->getNext())
+    {
+      unsigned long long contentHash;
+      if(!buildState.getContentHash(i->data, contentHash))
+        goto error;
+      if(file.write((const char*)&contentHash, sizeof(contentHash)) != sizeof(contentHash) || !writeString(file, i->data))
+        goto error;
+      entrySize += sizeof(contentHash) + sizeof(unsigned int) + i->data.getLength();
+    }
+    count = outputs.getSize();
+    if(!writeString(file, output) || file.write((const char*)&count, sizeof(count)) != sizeof(count))
+      goto error;
+    entrySize += sizeof(unsigned int) * 2 + output.getLength();
+    for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+    {
+      unsigned int permissions;
+      String content;
+      if(!File::getPermissions(i->data, permissions) || !readFile(i->data, content))
+        goto error;
+      if(file.write((const char*)&permissions, sizeof(permissions)) != sizeof(permissions) || !writeString(file, content))
+        goto error;
+      entrySize += sizeof(unsigned int) * 2 + content.getLength();
+    }
+    file.close();
+    if(!File::rename(tmpFile, entryFile))
+      goto error;
+    size += entrySize;
+    return;
+  }
+
+error:
+  file.close();
+  File::unlink(tmpFile);
+}
+
+String Cache::getEntryPath(unsigned long long key) const
+{
+  return String().format(dir.getLength() + 32, "%s/%02x/%016llx", dir.getData(), (unsigned int)(key >> 56), key);
+}
+
+unsigned long long Cache::getProgramFingerprint(const String& commandLine)
+{
+  // find the program name (after leading environment variables)
+  List<Word> command;
+  Word::split(commandLine, command);
+  const List<Word>::Node* i = command.getFirst();
+  while(i && strchr(i->data.getData(), '='))
+    i = i->getNext();
+  if(!i)
+    return 0;
+  const String& program = i->data;
+
+  // identify the program by its path, size and modification time
+  Map<String, unsigned long long>::Node* node = programFingerprints.find(program);
+  if(node)
+    return node->data;
+  Hash hash;
+  String path = Process::findProgram(program);
+  File::Status status;
+  if(File::getStatus(path, status))
+  {
+    hash.append(path);
+    hash.append(status.size);
+    hash.append(status.writeTime);
+  }
+  programFingerprints.append(program, hash.get());
+  return hash.get();
+}
+
+void Cache::evict()
+{
+  // determine the actual size of the cache
+  List<EntryFile> entries;
+  size = 0;
+  Directory dirs;
+  String name;
+  bool isDir;
+  if(dirs.open(dir, "*", true))
+    while(dirs.read(name, isDir))
+    {
+      String subdir = dir + "/" + name;
+      Directory files;
+      String fileName;
+      if(files.open(subdir, "*", false))
+        while(files.read(fileName, isDir))
+        {
+          if(isDir)
+            continue;
+          EntryFile& entry = entries.append();
+          entry.path = subdir + "/" + fileName;
+          File::Status status;
+          if(!File::getStatus(entry.path, status))
+          {
+            entries.removeLast();
+            continue;
+          }
+          entry.writeTime = status.writeTime;
+          entry.size = status.size;
+          size += status.size;
+        }
+    }
+
+  // remove the least recently used entries
+  entries.sort(EntryFile::compare);
+  unsigned long long targetSize = maxSize / 10 * 9;
+  for(const List<EntryFile>::Node* i = entries.getFirst(); i && size > targetSize; i = i->getNext())
+    if(File::unlink(i->data.path))
+      size -= i->data.size;
+}
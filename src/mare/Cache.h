@@ -0,0 +1,68 @@
+
+#pragma once
+
+#include "Tools/Map.h"
+#include "Tools/List.h"
+#include "Tools/String.h"
+
+class BuildState;
+
+/**
+* A local content-addressed cache for the output files of rules. An entry of the cache is addressed by a hash of the
+* commands of a rule, a fingerprint of the executed programs, the names of the output files and the content of the
+* input files. An entry stores the output files, the console output of the commands and the content hashes of the
+* additional prerequisites listed in the dependency file of the rule that have to match for the entry to be reused.
+*/
+class Cache
+{
+public:
+  /**
+  * @param dir The directory of the cache
+  * @param maxSize The size limit of the cache in bytes. The least recently used entries are removed when the limit is exceeded.
+  */
+  Cache(const String& dir, unsigned long long maxSize);
+
+  /** Updates the statistics file of the cache and removes old entries if the cache is too large */
+  ~Cache();
+
+  /**
+  * Computes the key of the cache entry for a rule
+  * @return The key or \c 0 if the output files of the rule cannot be cached (e.g. because an input file is missing)
+  */
+  unsigned long long getKey(const List<String>& command, const List<String>& inputs, const List<String>& outputs, BuildState& buildState);
+
+  /**
+  * Restores the output files of a rule from the cache
+  * @param key The key of the cache entry
+  * @param outputs The output files of the rule
+  * @param buildState The state database used to determine content hashes
+  * @param output The console output of the commands that were used to create the cache entry
+  * @return Whether the output files were restored
+  */
+  bool restore(unsigned long long key, const List<String>& outputs, BuildState& buildState, String& output);
+
+  /**
+  * Adds the output files of a rule to the cache
+  * @param key The key of the cache entry
+  * @param outputs The output files of the rule
+  * @param depfile The dependency file that lists further prerequisites of the output files or an empty string
+  * @param output The console output of the commands of the rule
+  * @param buildState The state database used to determine content hashes
+  */
+  void store(unsigned long long key, const List<String>& outputs, const String& depfile, const String& output, BuildState& buildState);
+
+  unsigned int getHits() const {return hits;}
+  unsigned int getMisses() const {return misses;}
+
+private:
+  String dir;
+  unsigned long long maxSize;
+  unsigned long long size; /**< The (approximated) size of all cache entries */
+  unsigned int hits;
+  unsigned int misses;
+  Map<String, unsigned long long> programFingerprints;
+
+  String getEntryPath(unsigned long long key) const;
+  unsigned long long getProgramFingerprint(const String& commandLine);
+  void evict();
+};
@@ -0,0 +1,193 @@
+
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Tools/Directory.h"
+#include "Tools/File.h"
+#include "Tools/Hash.h"
+#include "Tools/Map.h"
+#include "Tools/Process.h"
+
+#include "Engine.h"
+
+#include "GraphCache.h"
+
+static const char cacheDir[] = ".mare_graph";
+static const char fileHeader[] = "# mare graph v1\n";
+static const size_t fileHeaderLength = sizeof(fileHeader) - 1;
+
+static bool readFile(const String& path, String& data)
+{
+  File file;
+  if(!file.open(path))
+    return false;
+  char buffer[16384];
+  size_t i;
+  while((i = file.read(buffer, sizeof(buffer))) > 0)
+    data.append(buffer, i);
+  return true;
+}
+
+/** Returns the modification time of a file or directory (or \c 0 if it does not exist) bypassing the status cache */
+static long long getWriteTime(const String& path)
+{
+  File::invalidateStatus(path);
+  long long writeTime;
+  if(!File::getWriteTime(path, writeTime))
+    return 0;
+  return writeTime;
+}
+
+void GraphCache::Writer::write(const String& str)
+{
+  write((unsigned int)str.getLength());
+  data.append(str);
+}
+
+void GraphCache::Writer::write(const List<String>& list)
+{
+  write((unsigned int)list.getSize());
+  for(const List<String>::Node* i = list.getFirst(); i; i = i->getNext())
+    write(i->data);
+}
+
+bool GraphCache::Reader::read(void* buffer, size_t size)
+{
+  if((size_t)(end - pos) < size)
+    return false;
+  memcpy(buffer, pos, size);
+  pos += size;
+  return true;
+}
+
+bool GraphCache::Reader::read(String& str)
+{
+  unsigned int length;
+  if(!read(length) || (size_t)(end - pos) < length)
+    return false;
+  str = String(pos, length);
+  pos += length;
+  return true;
+}
+
+bool GraphCache::Reader::read(List<String>& list)
+{
+  unsigned int count;
+  if(!read(count))
+    return false;
+  for(unsigned int i = 0; i < count; ++i)
+    if(!read(list.append()))
+      return false;
+  return true;
+}
+
+GraphCache::GraphCache(const String& file, const String& key) : key(key), fileHash(0)
+{
+  String content;
+  if(readFile(file, content))
+    fileHash = Hash().append(content).get();
+  cacheFile = String().format(256, "%s/%016llx", cacheDir, Hash().append(file).append(key).get());
+}
+
+bool GraphCache::load(String& graph)
+{
+  if(!fileHash)
+    return false;
+  String data;
+  if(!readFile(cacheFile, data) || data.getLength() < fileHeaderLength || memcmp(data.getData(), fileHeader, fileHeaderLength) != 0)
+    return false;
+  Reader reader(data.substr(fileHeaderLength));
+
+  // check the settings and the content of the marefile
+  String cachedKey;
+  unsigned long long cachedFileHash, graphHash;
+  if(!reader.read(cachedKey) || cachedKey != key || !reader.read(cachedFileHash) || cachedFileHash != fileHash)
+    return false;
+
+  // check the used files and directories
+  unsigned int count;
+  if(!reader.read(count))
+    return false;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    String path;
+    unsigned long long writeTime;
+    if(!reader.read(path) || !reader.read(writeTime) || (long long)writeTime != getWriteTime(path))
+      return false;
+  }
+
+  // check the used environment variables
+  if(!reader.read(count))
+    return false;
+  const Map<String, String>& envs = Process::getEnvironmentVariables();
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    String name, value;
+    if(!reader.read(name) || !reader.read(value))
+      return false;
+    const Map<String, String>::Node* envNode = envs.find(name);
+    if(value != (envNode ? envNode->data : String()))
+      return false;
+  }
+
+  return reader.read(graphHash) && reader.read(graph) && Hash().append(graph).get() == graphHash;
+}
+
+bool GraphCache::save(const Engine& engine, const String& graph)
+{
+  if(!fileHash)
+    return false;
+  Writer writer;
+  writer.data.append(fileHeader, fileHeaderLength);
+  writer.write(key);
+  writer.write(fileHash);
+  const Map<String, void*>& paths = engine.getUsedPaths();
+  writer.write((unsigned int)paths.getSize());
+  for(const Map<String, void*>::Node* i = paths.getFirst(); i; i = i->getNext())
+  {
+    writer.write(i->key);
+    writer.write((unsigned long long)getWriteTime(i->key));
+  }
+  const Map<String, String>& envs = engine.getUsedEnvironmentVariables();
+  writer.write((unsigned int)envs.getSize());
+  for(const Map<String, String>::Node* i = envs.getFirst(); i; i = i->getNext())
+  {
+    writer.write(i->key);
+    writer.write(i->data);
+  }
+  writer.write(Hash().append(graph).get());
+  writer.write(graph);
+
+  // replace the cache file at once
+  Directory::create(cacheDir);
+#ifdef _WIN32
+  String tmpFile = cacheFile + String().format(32, ".%u.tmp", (unsigned int)GetCurrentProcessId());
+#else
+  String tmpFile = cacheFile + String().format(32, ".%u.tmp", (unsigned int)getpid());
+#endif
+  File file;
+  if(!file.open(tmpFile, File::writeFlag))
+    return false;
+  if(!file.write(writer.data))
+  {
+    file.close();
+    File::unlink(tmpFile);
+    return false;
+  }
+  file.close();
+  if(!File::rename(tmpFile, cacheFile))
+  {
+    File::unlink(tmpFile);
+    return false;
+  }
+  return true;
+}
+
+String GraphCache::getGlobsFile()
+{
+  return String(cacheDir) + "/globs";
+}
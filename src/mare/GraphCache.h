@@ -0,0 +1,75 @@
+
+#pragma once
+
+#include "Tools/List.h"
+#include "Tools/String.h"
+
+class Engine;
+
+/**
+* A cache for the rule graph that results from evaluating a marefile (in the directory ".mare_graph"). A cached graph
+* is used as long as the marefile, the files read with "readfile", the directories searched for wildcards and the used
+* environment variables are unchanged.
+*/
+class GraphCache
+{
+public:
+  /** A helper for composing the data of a graph */
+  class Writer
+  {
+  public:
+    String data;
+
+    void write(unsigned int value) {data.append((const char*)&value, sizeof(value));}
+    void write(unsigned long long value) {data.append((const char*)&value, sizeof(value));}
+    void write(const String& str);
+    void write(const List<String>& list);
+  };
+
+  /** A helper for reading the data of a graph */
+  class Reader
+  {
+  public:
+    Reader(const String& data) : pos(data.getData()), end(data.getData() + data.getLength()) {}
+
+    bool read(unsigned int& value) {return read(&value, sizeof(value));}
+    bool read(unsigned long long& value) {return read(&value, sizeof(value));}
+    bool read(String& str);
+    bool read(List<String>& list);
+
+  private:
+    const char* pos;
+    const char* end;
+
+    bool read(void* buffer, size_t size);
+  };
+
+  /**
+  * @param file The path of the marefile
+  * @param key The settings that affect the evaluation besides the marefile (like the selected targets)
+  */
+  GraphCache(const String& file, const String& key);
+
+  /**
+  * Loads the cached graph
+  * @param graph The data of the graph
+  * @return Whether a graph for the marefile and the key was found and is still valid
+  */
+  bool load(String& graph);
+
+  /**
+  * Stores a graph
+  * @param engine The engine that evaluated the marefile (which knows the files and environment variables that were used)
+  * @param graph The data of the graph
+  * @return Whether the graph was stored
+  */
+  bool save(const Engine& engine, const String& graph);
+
+  /** Returns the file for storing the results of the wildcard expansions of the engine (see \c Engine::saveGlobs) */
+  static String getGlobsFile();
+
+private:
+  String key;
+  String cacheFile;
+  unsigned long long fileHash; /**< A hash of the content of the marefile or \c 0 if it could not be read */
+};
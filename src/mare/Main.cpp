@@ -8,6 +8,8 @@
 #include "Tools/File.h"
 #include "Tools/Directory.h"
 #include "Tools/Error.h"
+#include "Tools/Clock.h"
+#include "Tools/Process.h"
 #ifdef _WIN32
 #include "Tools/Win32/getopt.h"
 #else
@@ -15,6 +17,10 @@
 #endif
 
 #include "Mare.h"
+#include "Cache.h"
+#include "Trace.h"
+#include "Stats.h"
+#include "Server.h"
 #include "Make.h"
 #include "Vcxproj.h"
 #include "Vcproj.h"
@@ -94,7 +100,8 @@ static void showUsage(const char* executable)
   puts("    config=<config>, --config=<config>");
   puts("        Build using configuration <config> as declared in the marefile (Debug");
   puts("        and Release by default). Multiple configurations can be used by adding");
-  puts("        config=<config> multiple times.");
+  puts("        config=<config> multiple times. The rules of all configurations are");
+  puts("        built at once.");
   puts("");
   puts("    <target>, target=<target>, --target=<target>");
   puts("        Build <target> as declared in the marefile. Multiple targets can be");
@@ -127,9 +134,77 @@ static void showUsage(const char* executable)
   puts("        Use <jobs> processes in parallel for building alle targets. The default");
   puts("        value for <jobs> is the number of processors on the host system.");
   puts("");
+  puts("    -k, --keep-going");
+  puts("        Keep going when a rule fails. All rules that do not depend on a failed");
+  puts("        rule are built nonetheless.");
+  puts("");
+  puts("    --fast-fail");
+  puts("        Terminate all running processes as soon as a rule fails.");
+  puts("");
+  puts("    -l <load>");
+  puts("        Do not start new processes while the system load average is at least");
+  puts("        <load> (unless no process of mare is running). With \"-l auto\" the");
+  puts("        limit is the number of available processors and new processes are");
+  puts("        also held back while the processors are under pressure.");
+  puts("");
+  puts("    --memory=<size>");
+  puts("        Do not start new processes if the sum of the memory estimates of all");
+  puts("        running processes would exceed <size> (e.g. 16G). The estimate of a");
+  puts("        rule is taken from its \"memory\" key or from the peak memory usage");
+  puts("        of its last execution. The default value of <size> is the amount of");
+  puts("        available memory.");
+  puts("");
+  puts("    --remote=<address>");
+  puts("        Send compile commands to the mare-worker at <address> instead of");
+  puts("        executing them locally. <address> is either unix:<path> or");
+  puts("        <host>:<port>. The commands are sent together with their input files");
+  puts("        as far as they are known from a previous dependency file. Link");
+  puts("        commands and commands that fail on the worker are executed locally.");
+  puts("        The token of the worker is taken from the environment variable");
+  puts("        MARE_WORKER_TOKEN. (not supported on Windows)");
+  puts("");
+  puts("    --remote-jobs=<jobs>");
+  puts("        Send up to <jobs> commands to the worker at once in addition to the");
+  puts("        local processes. The default value for <jobs> is 16.");
+  puts("");
   puts("    --ignore-dependencies");
   puts("        Do not respect dependencies between build targets.");
   puts("");
+  puts("    --hash");
+  puts("        Compare the content of input files instead of their modification times");
+  puts("        to determine whether an output file is outdated. The content");
+  puts("        fingerprints are cached in the build directory.");
+  puts("");
+  puts("    --cache=<dir>");
+  puts("        Store the output files of applied rules in the cache directory <dir>");
+  puts("        and restore them from there when a rule with the same commands and");
+  puts("        input files is applied again.");
+  puts("");
+  puts("    --cache-size=<size>");
+  puts("        Limit the size of the cache directory to <size> (e.g. 512M or 4G).");
+  puts("        The least recently used files are removed when the limit is exceeded.");
+  puts("        The default value of <size> is 5G.");
+  puts("");
+  puts("    --trace=<file>");
+  puts("        Record a timeline of the build in <file> using the Chrome trace event");
+  puts("        format, which can be viewed with Perfetto (ui.perfetto.dev). The");
+  puts("        timeline contains the executed commands in their job slots and the");
+  puts("        phases of mare itself.");
+  puts("");
+  puts("    --stats[=json]");
+  puts("        Print statistics about the build when it has finished: the wall time");
+  puts("        spent on evaluating the marefile and on executing commands, the summed");
+  puts("        execution and processor time of the commands, the average");
+  puts("        parallelism, the number of checked and applied rules, the slowest");
+  puts("        commands and the totals of each target. With \"--stats=json\" the");
+  puts("        statistics are printed as a JSON object.");
+  puts("");
+  puts("    --server");
+  puts("        Keep serving builds in the current directory. Subsequent invocations of");
+  puts("        mare in this directory are executed by the server, which keeps the");
+  puts("        parsed marefile and the status of the files used by the builds (which");
+  puts("        is updated using file change notifications). (Linux only)");
+  puts("");
   puts("    -h, --help");
   puts("        Display this help message or a help message declared in the marefile.");
   puts("");
@@ -145,8 +220,10 @@ static void showHelp(const char* executable)
   exit(EXIT_FAILURE);
 }
 
-int main(int argc, char* argv[])
+static int run(int argc, char* argv[], Server* server)
 {
+  int clientArgc = argc;
+  char** clientArgv = argv;
   Map<String, String> userArgs;
   List<String> inputPlatforms, inputConfigs, inputTargets;
   String inputFile("Marefile"), inputDir;
@@ -154,8 +231,19 @@ int main(int argc, char* argv[])
   bool showDebug = false;
   bool clean = false;
   bool rebuild = false;
+  bool keepGoing = false;
+  bool fastFail = false;
   bool ignoreDependencies = false;
+  bool hashMode = false;
+  String cacheDir;
+  unsigned long long cacheSize = 5ULL * 1024 * 1024 * 1024;
+  String traceFile;
+  int showStats = 0; /**< \c 1 for a summary or \c 2 for a JSON object */
   int jobs = 0;
+  double maxLoad = 0.;
+  unsigned long long memoryBudget = 0;
+  String remoteAddress;
+  int remoteJobs = 16;
   bool generateMake = false;
   int generateVcxproj = 0;
   int generateVcproj = 0;
@@ -163,6 +251,7 @@ int main(int argc, char* argv[])
   bool generateCodeBlocks = false;
   bool generateCMake = false;
   bool generateNetBeans = false;
+  bool serve = false;
 
   // parse args
   {
@@ -174,7 +263,17 @@ int main(int argc, char* argv[])
       {"directory", required_argument , 0, 'C'},
       {"clean", no_argument , 0, 0},
       {"rebuild", no_argument , 0, 0},
+      {"keep-going", no_argument , 0, 'k'},
+      {"fast-fail", no_argument , 0, 0},
       {"ignore-dependencies", no_argument , 0, 0},
+      {"hash", no_argument , 0, 0},
+      {"cache", required_argument , 0, 0},
+      {"cache-size", required_argument , 0, 0},
+      {"memory", required_argument , 0, 0},
+      {"remote", required_argument , 0, 0},
+      {"remote-jobs", required_argument , 0, 0},
+      {"trace", required_argument , 0, 0},
+      {"stats", optional_argument , 0, 0},
       {"make", no_argument , 0, 0},
       {"vcxproj", optional_argument , 0, 0},
       {"vcproj", optional_argument , 0, 0},
@@ -182,6 +281,7 @@ int main(int argc, char* argv[])
       {"codeblocks", no_argument , 0, 0},
       {"cmake", no_argument , 0, 0},
       {"netbeans", no_argument , 0, 0},
+      {"server", no_argument , 0, 0},
       {0, 0, 0, 0}
     };
 
@@ -229,7 +329,8 @@ int main(int argc, char* argv[])
     argv = nargv;
 
     // parse normal arguments
-    while((c = getopt_long(argc, argv, "C:df:hj:v", long_options, &option_index)) != -1)
+    optind = 1;
+    while((c = getopt_long(argc, argv, "C:df:hj:kl:v", long_options, &option_index)) != -1)
       switch(c)
       {
       case 0:
@@ -275,12 +376,51 @@ int main(int argc, char* argv[])
             generateCMake = true;
           else if(opt == "netbeans")
             generateNetBeans = true;
+          else if(opt == "server")
+            serve = true;
           else if(opt == "clean")
             clean = true;
           else if(opt == "rebuild")
             rebuild = true;
+          else if(opt == "fast-fail")
+            fastFail = true;
           else if(opt == "ignore-dependencies")
             ignoreDependencies = true;
+          else if(opt == "hash")
+            hashMode = true;
+          else if(opt == "cache")
+            cacheDir = String(optarg, -1);
+          else if(opt == "cache-size")
+          {
+            if(!Mare::parseSize(optarg, cacheSize))
+              ::showHelp(argv[0]);
+          }
+          else if(opt == "memory")
+          {
+            if(!Mare::parseSize(optarg, memoryBudget))
+              ::showHelp(argv[0]);
+          }
+          else if(opt == "remote")
+            remoteAddress = String(optarg, -1);
+          else if(opt == "remote-jobs")
+          {
+            remoteJobs = atoi(optarg);
+            if(remoteJobs <= 0)
+              ::showHelp(argv[0]);
+          }
+          else if(opt == "trace")
+            traceFile = String(optarg, -1);
+          else if(opt == "stats")
+          {
+            showStats = 1;
+            if(optarg)
+            {
+              if(strcmp(optarg, "json") == 0)
+                showStats = 2;
+              else
+                ::showHelp(argv[0]);
+            }
+          }
         }
         break;
       case 'C':
@@ -298,6 +438,20 @@ int main(int argc, char* argv[])
       case 'j':
         jobs = atoi(optarg);
         break;
+      case 'k':
+        keepGoing = true;
+        break;
+      case 'l':
+        if(strcmp(optarg, "auto") == 0)
+          maxLoad = -1.;
+        else
+        {
+          char* end;
+          maxLoad = strtod(optarg, &end);
+          if(end == optarg || *end || maxLoad < 0.)
+            ::showHelp(argv[0]);
+        }
+        break;
       case 'v':
         showVersion(true);
         break;
@@ -335,8 +489,8 @@ int main(int argc, char* argv[])
     }
   }
 
-  // change working directory?
-  if(!inputDir.isEmpty())
+  // change working directory? (a server is already in the directory of the client)
+  if(!inputDir.isEmpty() && !server)
   {
     if(!Directory::change(inputDir))
     {
@@ -345,10 +499,45 @@ int main(int argc, char* argv[])
     }
   }
 
+  // serve builds or let the server of the directory do the build
+  if(serve && !server)
+  {
+    Server buildServer(inputFile, errorHandler, argv[0]);
+    return buildServer.run(run) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if(!server)
+  {
+    int exitCode;
+    if(Server::forward(clientArgc, clientArgv, exitCode))
+      return exitCode;
+  }
+
+  Stats stats;
+
+  // create the trace file
+  Trace trace;
+  if(!traceFile.isEmpty() && !trace.open(traceFile))
+  {
+    fprintf(stderr, "%s: %s: %s\n", argv[0], traceFile.getData(), Error::getString().getData());
+    return EXIT_FAILURE;
+  }
+
   // start the engine
   {
-    Engine engine(errorHandler, argv[0]);
-    if(!engine.load(inputFile))
+    Engine localEngine(errorHandler, argv[0]);
+    Engine* serverEngine = server ? server->getEngine(inputFile) : 0;
+    Engine& engine = serverEngine ? *serverEngine : localEngine;
+    bool generate = generateMake || generateVcxproj || generateVcproj || generateCodeLite || generateCodeBlocks || generateCMake || generateNetBeans;
+    bool loaded = true;
+    if(!serverEngine && (showHelp || generate)) // a direct build loads the marefile only if its cached rule graph is outdated
+    {
+      long long parseStartTime = Clock::getMicroseconds();
+      loaded = engine.load(inputFile);
+      long long parseEndTime = Clock::getMicroseconds();
+      trace.addEvent("parse", inputFile, parseStartTime, parseEndTime);
+      stats.addEvaluationTime(parseEndTime - parseStartTime);
+    }
+    if(!loaded)
     {
       if(showHelp)
         showUsage(argv[0]);
@@ -437,10 +626,33 @@ int main(int argc, char* argv[])
 
     // direct build
     {
-      Mare mare(engine, inputPlatforms, inputConfigs, inputTargets, showDebug, clean, rebuild, jobs, ignoreDependencies);
-      if(!mare.build(userArgs))
+      Cache* cache = cacheDir.isEmpty() ? 0 : new Cache(cacheDir, cacheSize);
+      String remoteWorker;
+      if(!remoteAddress.isEmpty())
+      {
+        // use the mare-worker next to the mare executable
+        remoteWorker = File::getDirname(Process::findProgram(String(argv[0], -1))) + "/mare-worker";
+        if(!File::exists(remoteWorker))
+          remoteWorker = Process::findProgram("mare-worker");
+      }
+      Mare mare(engine, inputFile, inputPlatforms, inputConfigs, inputTargets, showDebug, clean, rebuild, keepGoing, fastFail, jobs, maxLoad, memoryBudget, remoteAddress, remoteWorker, remoteJobs, ignoreDependencies, hashMode, cache, traceFile.isEmpty() ? 0 : &trace, showStats ? &stats : 0);
+      bool result = mare.build(userArgs);
+      if(showStats)
+        stats.print(showStats == 2);
+      if(cache)
+      {
+        if(showDebug)
+          printf("debug: Cache hits: %u, cache misses: %u\n", cache->getHits(), cache->getMisses());
+        delete cache;
+      }
+      if(!result)
         return EXIT_FAILURE;
       return EXIT_SUCCESS;
     }
   }
 }
+
+int main(int argc, char* argv[])
+{
+  return run(argc, argv, 0);
+}
@@ -1,5 +1,7 @@
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctype.h>
 
 #include "Mare.h"
@@ -9,10 +11,46 @@
 #include "Tools/File.h"
 #include "Tools/Directory.h"
 #include "Tools/Error.h"
+#include "Tools/Hash.h"
+#include "Tools/Heap.h"
+#include "Tools/Clock.h"
+#include "Tools/Word.h"
 #include "Engine.h"
 
+#include "BuildState.h"
+#include "Cache.h"
+#include "GraphCache.h"
+#include "Trace.h"
+#include "Stats.h"
+
+/** The version of the cached rule graphs (which has to be increased when the stored rules or the default rules are changed) */
+static const char graphVersion[] = "rules v1";
+
+/** The exit code of "mare-worker --submit" when the worker could not execute the command (which is then executed locally) */
+static const unsigned int remoteFailureExitCode = 125;
+
 bool Mare::build(const Map<String, String>& userArgs)
 {
+  // use the rule graph of a previous evaluation if the marefile and everything used by it are unchanged
+  GraphCache graphCache(inputFile, getGraphKey(userArgs));
+  bool result;
+  if(!clean && buildCachedGraph(graphCache, result))
+    return result;
+
+  // load the marefile
+  if(!engine.isLoaded())
+  {
+    long long parseStartTime = Clock::getMicroseconds();
+    bool loaded = engine.load(inputFile);
+    long long parseEndTime = Clock::getMicroseconds();
+    if(trace)
+      trace->addEvent("parse", inputFile, parseStartTime, parseEndTime);
+    if(stats)
+      stats->addEvaluationTime(parseEndTime - parseStartTime);
+    if(!loaded)
+      return false;
+  }
+
   // add default rules and stuff
   engine.addDefaultKey("cCompiler", "gcc");
   engine.addDefaultKey("cppCompiler", "g++");
@@ -83,8 +121,9 @@ bool Mare::build(const Map<String, String>& userArgs)
     Map<String, String> cppSource;
     cppSource.append("__ofile", "$(buildDir)/$(basename $(subst ../,,$(file))).o");
     cppSource.append("__dfile", "$(patsubst %.o,%.d,$(__ofile))");
-    cppSource.append("input", "$(file) $(filter-out %.o: \\,$(readfile $(__dfile)))");
+    cppSource.append("input", "$(file)");
     cppSource.append("output", "$(__ofile) $(__dfile)");
+    cppSource.append("depfile", "$(__dfile)");
     cppSource.append("command", "$(cppCompiler) -MMD $(__soFlags) -o $(__ofile) -c $(file) $(cppFlags) $(CXXFLAGS) $(CPPFLAGS) $(LDFLAGS) $(patsubst %,-D%,$(defines)) $(patsubst %,-I%,$(includePaths))");
     cppSource.append("message", "$(subst ./,,$(file))");
     engine.addDefaultKey("cppSource", cppSource);
@@ -93,8 +132,9 @@ bool Mare::build(const Map<String, String>& userArgs)
     Map<String, String> cSource;
     cSource.append("__ofile", "$(buildDir)/$(basename $(subst ../,,$(file))).o");
     cSource.append("__dfile", "$(patsubst %.o,%.d,$(__ofile))");
-    cSource.append("input", "$(file) $(filter-out %.o: \\,$(readfile $(__dfile)))");
+    cSource.append("input", "$(file)");
     cSource.append("output", "$(__ofile) $(__dfile)");
+    cSource.append("depfile", "$(__dfile)");
     cSource.append("command", "$(cCompiler) -MMD $(__soFlags) -o $(__ofile) -c $(file) $(cFlags) $(CFLAGS) $(CPPFLAGS) $(LDFLAGS) $(patsubst %,-D%,$(defines)) $(patsubst %,-I%,$(includePaths))");
     cSource.append("message", "$(subst ./,,$(file))");
     engine.addDefaultKey("cSource", cSource);
@@ -121,103 +161,47 @@ bool Mare::build(const Map<String, String>& userArgs)
   for(const Map<String, String>::Node* i = userArgs.getFirst(); i; i = i->getNext())
     engine.addCommandLineKey(i->key, i->data);
 
-  // build 
-  if(!buildFile())
-    return false;
+  // reuse the results of the wildcard expansions of the previous evaluation
+  engine.loadGlobs(GraphCache::getGlobsFile());
 
-  return true;
+  // build 
+  return buildFile(clean ? 0 : &graphCache);
 }
 
-bool Mare::buildFile()
+String Mare::getGraphKey(const Map<String, String>& userArgs) const
 {
-  // enter root key
-  engine.enterRootKey();
-
-  // read default or check input platform names
-  VERIFY(engine.enterKey("platforms"));
-  if(inputPlatforms.isEmpty())
-  {
-    String firstPlatform = engine.getFirstKey();
-    if(!firstPlatform.isEmpty())
-      inputPlatforms.append(firstPlatform);
-    else
-    {
-      engine.error("cannot find any platforms");
-      return false;
-    }
-  }
-  else
-    for(const List<String>::Node* i = inputPlatforms.getFirst(); i; i = i->getNext())
-      if(!engine.hasKey(i->data))
-      {
-        engine.error(String().format(256, "cannot find platform \"%s\"", i->data.getData()));
-        return false;
-      }
-  engine.leaveKey();
-
-  // read default or check input configuration names
-  VERIFY(engine.enterKey("configurations"));
-  if(inputConfigs.isEmpty())
-  {
-    String firstConfiguration = engine.getFirstKey();
-    if(!firstConfiguration.isEmpty())
-      inputConfigs.append(firstConfiguration);
-    else
-    {
-      engine.error("cannot find any configurations");
-      return false;
-    }
-  }
-  else
-    for(const List<String>::Node* i = inputConfigs.getFirst(); i; i = i->getNext())
-      if(!engine.hasKey(i->data))
-      {
-        engine.error(String().format(256, "cannot find configuration \"%s\"", i->data.getData()));
-        return false;
-      }
-  engine.leaveKey();
-
-  // read default or check input target names
-  VERIFY(engine.enterKey("targets"));
-  engine.getKeys(allTargets);
-  if(inputTargets.isEmpty())
-  {
-    if(!allTargets.isEmpty())
-      inputTargets.append(allTargets.getFirst()->data);
-    else
-    {
-      engine.error("cannot find any targets");
-      return false;
-    }
-  }
-  else
-    for(const List<String>::Node* i = inputTargets.getFirst(); i; i = i->getNext())
-      if(!engine.hasKey(i->data))
-      {
-        engine.error(String().format(256, "cannot find target \"%s\"", i->data.getData()));
-        return false;
-      }
-  engine.leaveKey();
-
-  // leave root key
-  engine.leaveKey(); 
-
-  // build input targets (with dependencies) foreach input configuration
-  for(const List<String>::Node* i = inputPlatforms.getFirst(); i; i = i->getNext())
+  String key(graphVersion);
+  key.append("\nplatforms ");
+  key.append(join(inputPlatforms));
+  key.append("\nconfigurations ");
+  key.append(join(inputConfigs));
+  key.append("\ntargets ");
+  key.append(join(inputTargets));
+  for(const Map<String, String>::Node* i = userArgs.getFirst(); i; i = i->getNext())
   {
-    const String& platform = i->data;
-    for(const List<String>::Node* i = inputConfigs.getFirst(); i; i = i->getNext())
-    {
-      const String& configuration = i->data;
-      if(!buildTargets(platform, configuration))
-        return false;
-    }
+    key.append("\nuser ");
+    key.append(i->key);
+    key.append('=');
+    key.append(i->data);
   }
-
-  return true;
+  if(ignoreDependencies)
+    key.append("\nignore-dependencies");
+  return key;
 }
 
 class Target;
+class Rule;
+
+/** A named group of rules whose number of concurrently executed commands is limited */
+class Pool
+{
+public:
+  unsigned int depth; /**< The maximum number of rules of the pool that can be executed at once or \c 0 for no limit */
+  unsigned int runningJobs;
+  Heap<Rule*> waitingJobs; /**< Rules that wait for a running rule of the pool to finish */
+
+  Pool() : depth(0), runningJobs(0) {}
+};
 
 class Rule
 {
@@ -233,15 +217,43 @@ public:
   List<String> message;
   
   unsigned int finishedRuleDependencies;
-  Map<Rule*, String> ruleDependencies;
+  Map<Rule*, String> ruleDependencies; /**< The rules that create input files of this rule (or an empty string for rules of other configurations that create the same output files) */
   Map<Rule*, String> rulePropagations;
 
   bool rebuild;
+  bool restat; /**< Whether dependent rules should only be applied if the commands changed the content of the output files (the "restat" key) */
+  bool unchanged; /**< Whether the commands of the rule were executed without changing the content of the output files */
+  unsigned long long outputsHash; /**< A hash of the content of the output files before the commands were executed (for "restat") */
+  Map<String, void*> restatInputs; /**< Input files that are created by rules with "restat" */
+  unsigned int declaredInputs; /**< The number of input files that were declared by the rule (the following ones are added from the dependency file or for dependencies) */
+  String depfile; /**< A Makefile-style dependency file that is written by the commands and lists additional input files (the "depfile" key) */
+
+  BuildState* buildState; /**< The state database of the build directory of the rule's target */
 
   const List<String>::Node* nextCommand;
   Process process;
 
-  Rule() : finishedRuleDependencies(0), rebuild(false) {}
+  unsigned long long cacheKey; /**< The key of the cache entry for the output files or \c 0 if the output files are not cached */
+  String capturedOutput; /**< The console output of the commands when the output files are cached */
+  String runningCommand; /**< The command line of the process that is currently executed */
+  unsigned int runningPid; /**< The process id of the process that is currently executed */
+  long long commandStartTime; /**< The time when the process that is currently executed was started */
+  unsigned int slot; /**< The job slot that is occupied by the rule while its commands are executed (starting at 1) or \c 0 */
+
+  long long startTime; /**< The time when the execution of the commands was started */
+  long long criticalPath; /**< The (estimated) time needed to execute this rule and all rules depending on it or \c -1 if not determined yet */
+
+  unsigned long long memory; /**< The amount of memory required by the commands as declared with the "memory" key or \c 0 */
+  unsigned long long peakMemory; /**< The peak memory usage of the commands that were executed */
+  unsigned long long reservedMemory; /**< The amount of memory reserved for the rule while its commands are executed */
+
+  Pool* pool; /**< The pool of the rule as declared with the "pool" key or \c 0 */
+  Pool* reservedPool; /**< The pool in which the rule occupies a slot while its commands are executed */
+
+  bool remote; /**< Whether the command of the rule is sent to a worker (see \c Mare::remoteAddress) */
+  bool localRetry; /**< Whether the command failed on the worker and is executed locally once the rule is admitted again */
+
+  Rule() : finishedRuleDependencies(0), rebuild(false), restat(false), unchanged(false), outputsHash(0), declaredInputs(0), buildState(0), cacheKey(0), runningPid(0), commandStartTime(0), slot(0), criticalPath(-1), memory(0), peakMemory(0), reservedMemory(0), pool(0), reservedPool(0), remote(false), localRetry(false) {}
 
   bool startExecution(unsigned int& pid)
   {
@@ -258,7 +270,7 @@ public:
 
     // determine whether to build this rule
     for(Map<Rule*, String>::Node* i = ruleDependencies.getFirst(); i; i = i->getNext())
-      if(i->key->rebuild)
+      if(i->key->rebuild && !i->key->unchanged && !i->data.isEmpty())
       {
         if(builder->showDebug)
           printf("debug: Applying rule for \"%s\" since the rule for the input file \"%s\" was applied as well\n", name.getData(), i->data.getData());
@@ -266,6 +278,8 @@ public:
       }
     if(!outputs.isEmpty())
     {
+      unsigned long long commandHash = buildState ? getCommandHash() : 0;
+      bool recorded = buildState != 0; // whether the state of each output file has been recorded after its creation
       long long minWriteTime = 0;
       String minOutputFile;
       for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
@@ -283,17 +297,46 @@ public:
           }
           goto build;
         }
+        if(buildState)
+        {
+          const BuildState::Entry* entry = buildState->find(file);
+          if(entry)
+          {
+            if(entry->commandHash != commandHash)
+            {
+              if(builder->showDebug)
+                printf("debug: Applying rule for \"%s\" since the command used to create the output file \"%s\" has changed\n", name.getData(), file.getData());
+              goto build;
+            }
+            if(entry->writeTime != writeTime)
+              recorded = false;
+          }
+          else
+            recorded = false;
+        }
         if(i == outputs.getFirst() || writeTime < minWriteTime)
         {
           minWriteTime = writeTime;
           minOutputFile = file;
         }
       }
+      if(!depfile.isEmpty() && buildState)
+      {
+        long long writeTime;
+        if(!File::getWriteTime(depfile, writeTime) || buildState->getDepsWriteTime(depfile) != writeTime)
+        {
+          if(builder->showDebug)
+            printf("debug: Applying rule for \"%s\" since the dependency file \"%s\" has not been recorded\n", name.getData(), depfile.getData());
+          goto build;
+        }
+      }
+      Hash inputsHash;
       for(const List<String>::Node* i = inputs.getFirst(); i; i = i->getNext())
       {
         const String& file = i->data;
         long long writeTime;
-        if(!File::getWriteTime(file, writeTime))
+        bool contentTime = buildState && (builder->hashMode || (!restatInputs.isEmpty() && restatInputs.find(file))); // use the time of the last content change
+        if(contentTime ? !buildState->getContentTime(file, writeTime) : !File::getWriteTime(file, writeTime))
         {
           if(builder->showDebug)
           {
@@ -308,9 +351,44 @@ public:
                                      // with a timestamp resolutions of a second when compiling and linking can be done in less than a second.
         {
           if(builder->showDebug)
-            printf("debug: Applying rule for \"%s\" since the input file \"%s\" is newer than output file \"%s\"\n", name.getData(), file.getData(), minOutputFile.getData());
+          {
+            if(contentTime)
+              printf("debug: Applying rule for \"%s\" since the content of input file \"%s\" has changed after output file \"%s\" was created\n", name.getData(), file.getData(), minOutputFile.getData());
+            else
+              printf("debug: Applying rule for \"%s\" since the input file \"%s\" is newer than output file \"%s\"\n", name.getData(), file.getData(), minOutputFile.getData());
+          }
           goto build;
         }
+        if(buildState)
+        {
+          inputsHash.append(file);
+          inputsHash.append(writeTime);
+        }
+      }
+      if(buildState)
+      {
+        // detect changed input files that are not newer than the output files (e.g. removed input files or files restored from backups)
+        if(recorded)
+          for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+          {
+            const BuildState::Entry* entry = buildState->find(i->data);
+            if(entry->inputsHash != 0 && entry->inputsHash != inputsHash.get())
+            {
+              if(builder->showDebug)
+                printf("debug: Applying rule for \"%s\" since its input files have changed after the output file \"%s\" was created\n", name.getData(), i->data.getData());
+              goto build;
+            }
+          }
+
+        // remember the up-to-date state of the output files
+        for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+        {
+          const BuildState::Entry* entry = buildState->find(i->data);
+          long long writeTime;
+          if(!entry || entry->inputsHash != inputsHash.get() || !recorded)
+            if(File::getWriteTime(i->data, writeTime))
+              buildState->record(i->data, commandHash, writeTime, inputsHash.get());
+        }
       }
     }
 
@@ -327,6 +405,7 @@ clean:
       {
         if(!File::unlink(i->data))
           builder->engine.error(Error::getString());
+        File::invalidateStatus(i->data);
       }
       if(!builder->rebuild)
       {
@@ -356,24 +435,100 @@ clean:
 
     if(!message.isEmpty())
     {
+      String text;
       for(const List<String>::Node* i = message.getFirst(); i; i = i->getNext())
-        puts(i->data.getData());
-      fflush(stdout);
+      {
+        text.append(i->data);
+        text.append('\n');
+      }
+      writeOutput(text);
     }
 
     // create output directories
     for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
       Directory::create(File::getDirname(i->data));
 
+    if(restat)
+      outputsHash = getOutputsHash(false);
+
+    startTime = Clock::getMicroseconds();
+
+    // try to restore the output files from the cache
+    if(builder->cache && buildState && !command.isEmpty())
+    {
+      cacheKey = builder->cache->getKey(command, inputs, outputs, *buildState);
+      if(cacheKey && !builder->rebuild)
+      {
+        String output;
+        if(builder->cache->restore(cacheKey, outputs, *buildState, output))
+        {
+          invalidateOutputs();
+          if(builder->showDebug)
+            printf("debug: Restored the output files of the rule for \"%s\" from the cache\n", name.getData());
+          String text;
+          if(message.isEmpty())
+            for(const List<String>::Node* i = command.getFirst(); i; i = i->getNext())
+              if(!i->data.isEmpty())
+              {
+                text.append(i->data);
+                text.append('\n');
+              }
+          text.append(output);
+          writeOutput(text);
+          recordState();
+          pid = 0;
+          return true;
+        }
+      }
+    }
+
     nextCommand = command.getFirst();
     return continueExecution(pid);
   }
 
   bool continueExecution(unsigned int& pid)
   {
-    if(process.isRunning())
+    String singleCommand;
+    if(localRetry)
+    {
+      localRetry = false;
+      singleCommand = runningCommand;
+    }
+    else if(process.isRunning())
     {
       unsigned int exitCode = process.join();
+      if(builder->trace || builder->stats)
+        recordCommand(exitCode);
+      if(!remote && process.getPeakMemory() > peakMemory)
+        peakMemory = process.getPeakMemory();
+      invalidateOutputs();
+      if(remote)
+      {
+        File::unlink(getRemoteRequestFile());
+        if(exitCode == remoteFailureExitCode)
+        {
+          // the worker could not be reached or lacked an input file that is not listed in the last dependency file
+          // (the rule is admitted again under the local limits before the command is executed locally)
+          if(builder->showDebug)
+            printf("debug: The command of the rule for \"%s\" could not be executed by the worker and is executed locally\n%s", name.getData(), process.getOutput().getData());
+          localRetry = true;
+          pid = 0;
+          return true;
+        }
+      }
+      if(cacheKey)
+        capturedOutput.append(process.getOutput());
+
+      // print the command line together with its output
+      String text;
+      if(message.isEmpty())
+      {
+        text.append(runningCommand);
+        text.append('\n');
+      }
+      text.append(process.getOutput());
+      writeOutput(text);
+
       if(exitCode != 0)
       {
         pid = 0;
@@ -381,41 +536,251 @@ clean:
       }
     }
 
-    String singleCommand;
-    while(nextCommand)
+    while(singleCommand.isEmpty() && nextCommand)
     {
       singleCommand = nextCommand->data;
       nextCommand = nextCommand->getNext();
-      if(!singleCommand.isEmpty())
-        break;
     }
 
     if(singleCommand.isEmpty())
     {
+      if(restat && outputsHash && getOutputsHash(true) == outputsHash)
+      {
+        unchanged = true;
+        if(builder->showDebug)
+          printf("debug: The output files of the rule for \"%s\" were not changed\n", name.getData());
+      }
+      recordState();
+      if(buildState)
+      {
+        buildState->recordDuration(outputs.getFirst()->data, Clock::getMicroseconds() - startTime);
+        if(peakMemory)
+          buildState->recordPeakMemory(outputs.getFirst()->data, peakMemory);
+      }
+      if(cacheKey)
+        builder->cache->store(cacheKey, outputs, depfile, capturedOutput, *buildState);
       pid = 0;
       return true;
     }
 
-    if(message.isEmpty())
+    if(builder->showDebug)
     {
-      puts(singleCommand.getData());
+      if(remote)
+        printf("debug: %s (on %s)\n", singleCommand.getData(), builder->remoteAddress.getData());
+      else
+        printf("debug: %s\n", singleCommand.getData());
       fflush(stdout);
     }
 
-    if(builder->showDebug)
+    commandStartTime = Clock::getMicroseconds();
+    if(remote)
     {
-      printf("debug: %s\n", singleCommand.getData());
-      fflush(stdout);
+      if(!writeRemoteRequest(singleCommand))
+      {
+        builder->engine.error(String().format(256, "cannot write \"%s\": %s", getRemoteRequestFile().getData(), Error::getString().getData()));
+        return false;
+      }
+      pid = process.start(String("\"") + builder->remoteWorker + "\" --submit=" + builder->remoteAddress + " \"" + getRemoteRequestFile() + "\"");
     }
-
-    pid = process.start(singleCommand);
+    else
+      pid = process.start(singleCommand);
     if(!pid)
     {
       builder->engine.error(Error::getString());
       return false;
     }
+    runningCommand = singleCommand;
+    runningPid = pid;
+    return true;
+  }
+
+  /** Returns whether the running command of the rule is its last command */
+  bool isRunningLastCommand() const
+  {
+    for(const List<String>::Node* i = nextCommand; i; i = i->getNext())
+      if(!i->data.isEmpty())
+        return false;
+    return true;
+  }
+
+  /** Cleans up after the running command of the rule was terminated. The output files are deleted since they might be incomplete. */
+  void abortExecution()
+  {
+    process.join();
+    if(remote)
+      File::unlink(getRemoteRequestFile());
+    for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+      if(File::exists(i->data))
+      {
+        File::unlink(i->data);
+        File::invalidateStatus(i->data);
+      }
+    if(builder->showDebug)
+      printf("debug: Terminated the command of the rule for \"%s\"\n", name.getData());
+  }
+
+  /**
+  * Returns whether the command of the rule can be sent to a worker. This is the case for rules with a single command
+  * and a dependency file (i.e. compile rules) whose input files are known from a previous execution. Other rules (like
+  * link rules) are kept local.
+  */
+  bool isRemoteCandidate() const
+  {
+    if(depfile.isEmpty() || !buildState || !buildState->getDepsWriteTime(depfile))
+      return false;
+    unsigned int commands = 0;
+    for(const List<String>::Node* i = command.getFirst(); i; i = i->getNext())
+      if(!i->data.isEmpty())
+        ++commands;
+    return commands == 1;
+  }
+
+  /** Returns the path of the file that describes the command of the rule for the worker */
+  String getRemoteRequestFile() const
+  {
+    return outputs.getFirst()->data + ".remote";
+  }
+
+  /** Writes the file that describes the command, the input files and the output files of the rule for the worker */
+  bool writeRemoteRequest(const String& command) const
+  {
+    String request("command ");
+    request.append(command);
+    request.append('\n');
+    for(const List<String>::Node* i = inputs.getFirst(); i; i = i->getNext())
+    {
+      request.append("input ");
+      request.append(i->data);
+      request.append('\n');
+    }
+    for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+    {
+      request.append("output ");
+      request.append(i->data);
+      request.append('\n');
+    }
+    request.append("output ");
+    request.append(depfile);
+    request.append('\n');
+    File file;
+    return file.open(getRemoteRequestFile(), File::writeFlag) && file.write(request);
+  }
+
+  /** Reads the "memory" key of the rule */
+  void readMemory(Engine& engine)
+  {
+    String memory = engine.getFirstKey("memory", false);
+    if(!memory.isEmpty() && !Mare::parseSize(memory.getData(), this->memory))
+      printf("warning: Rule for \"%s\" has an invalid memory size \"%s\"\n", name.getData(), memory.getData());
+  }
+
+  /** Reads the "depfile" key of the rule and adds the prerequisites of the dependency file to the input files */
+  void readDepfile(Engine& engine)
+  {
+    depfile = engine.getFirstKey("depfile", false);
+    if(!depfile.isEmpty())
+      addDepfileInputs();
+  }
+
+  /** Adds the prerequisites of the dependency file to the input files */
+  void addDepfileInputs()
+  {
+    if(buildState)
+      buildState->getDeps(depfile, inputs);
+    else
+      BuildState::readDepfile(depfile, inputs);
+  }
+
+  /** Reads the "pool" key of the rule */
+  bool readPool(Engine& engine, Map<String, Pool>& pools)
+  {
+    String pool = engine.getFirstKey("pool", false);
+    if(pool.isEmpty())
+      return true;
+    Map<String, Pool>::Node* node = pools.find(pool);
+    if(!node)
+    {
+      engine.error(String().format(256, "cannot find pool \"%s\" for rule \"%s\"", pool.getData(), name.getData()));
+      return false;
+    }
+    this->pool = &node->data;
     return true;
   }
+
+  /** Returns the amount of memory that is (probably) required by the commands of the rule */
+  unsigned long long getMemoryEstimate() const
+  {
+    if(memory)
+      return memory;
+    if(buildState && !outputs.isEmpty())
+      return buildState->getPeakMemory(outputs.getFirst()->data);
+    return 0;
+  }
+
+  unsigned long long getCommandHash() const
+  {
+    Hash hash;
+    for(const List<String>::Node* i = command.getFirst(); i; i = i->getNext())
+      hash.append(i->data);
+    return hash.get();
+  }
+
+  /**
+  * Computes a hash of the content of the output files
+  * @param reread Whether the output files have to be read (since they were just written)
+  * @return The hash or \c 0 if an output file does not exist
+  */
+  unsigned long long getOutputsHash(bool reread)
+  {
+    if(!buildState)
+      return 0;
+    Hash hash;
+    for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+    {
+      unsigned long long contentHash;
+      if(!buildState->getContentHash(i->data, contentHash, reread))
+        return 0;
+      hash.append((long long)contentHash);
+    }
+    return hash.get() ? hash.get() : 1;
+  }
+
+  /** Removes the output files from the file status cache after they were modified */
+  void invalidateOutputs()
+  {
+    for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+      File::invalidateStatus(i->data);
+    if(!depfile.isEmpty())
+      File::invalidateStatus(depfile);
+  }
+
+  /** Adds the command that was executed to the trace and the statistics */
+  void recordCommand(unsigned int exitCode);
+
+  /** Writes text to the console at once, so that it does not get mixed up with the output of other rules */
+  static void writeOutput(const String& text)
+  {
+    if(text.isEmpty())
+      return;
+    fwrite(text.getData(), 1, text.getLength(), stdout);
+    fflush(stdout);
+  }
+
+  /** Records the state of the output files after the commands of the rule were executed successfully */
+  void recordState()
+  {
+    if(!buildState)
+      return;
+    unsigned long long commandHash = getCommandHash();
+    for(const List<String>::Node* i = outputs.getFirst(); i; i = i->getNext())
+    {
+      long long writeTime;
+      if(File::getWriteTime(i->data, writeTime))
+        buildState->record(i->data, commandHash, writeTime, 0); // the input files are not known until the rule is evaluated again (e.g. because of changed dependency files)
+    }
+    if(!depfile.isEmpty() && !buildState->recordDeps(depfile))
+      printf("warning: Cannot read dependency file \"%s\" of rule for \"%s\"\n", depfile.getData(), name.getData());
+  }
 };
 
 class Target
@@ -428,19 +793,51 @@ public:
   Target() : active(false) {}
 };
 
-class RuleSet
+void Rule::recordCommand(unsigned int exitCode)
+{
+  long long endTime = Clock::getMicroseconds();
+  if(builder->trace)
+  {
+    Map<String, String> args;
+    args.append("rule", name);
+    args.append("target", target->rule->name);
+    args.append("command", runningCommand);
+    args.append("pid", String().format(32, "%u", runningPid));
+    args.append("exitCode", String().format(32, "%u", exitCode));
+    builder->trace->addEvent("command", name, commandStartTime, endTime, slot, &args);
+  }
+  if(builder->stats)
+    builder->stats->addCommand(target->rule->name, name, runningCommand, endTime - commandStartTime, process.getCpuTime());
+}
+
+/** The targets of a platform and configuration */
+class TargetSet
 {
 public:
   Map<String, Target> targets;
   List<Target*> activeTargets;
+};
 
-  unsigned int activeRules;
-  unsigned int finishedRules;
-
-  RuleSet() : activeRules(0), finishedRules(0) {}
+/** The rules of all platforms and configurations that are built at once */
+class RuleSet
+{
+public:
+  List<TargetSet> targetSets;
+  List<Target*> activeTargets;
+  Map<String, BuildState> buildStates;
+  Map<String, Pool> pools;
+  Map<String, Rule*> outputToRule; /**< The active rules of all target sets by output file */
+
+  unsigned int activeRules;
+  unsigned int finishedRules;
 
-  void resolveDependencies(bool activateDependencies)
+  RuleSet() : activeRules(0), finishedRules(0) {}
+
+  void resolveDependencies(TargetSet& targetSet, bool activateDependencies)
   {
+    Map<String, Target>& targets = targetSet.targets;
+    List<Target*>& activeTargets = targetSet.activeTargets;
+
     // generate outputToRule map
     Map<String, Rule*> outputToRule;
     for(Map<String, Target>::Node* i = targets.getFirst(); i; i = i->getNext())
@@ -514,55 +911,282 @@ public:
             //
             if(!rule.ruleDependencies.find(dependency))
               rule.ruleDependencies.append(dependency, i->data);
+            if(dependency->restat && !rule.restatInputs.find(i->data))
+              rule.restatInputs.append(i->data, 0);
             if(!dependency->rulePropagations.find(&rule))
               dependency->rulePropagations.append(&rule, i->data);
           }
         }
       }
+
+    // add the active rules to the rules of the other target sets
+    for(List<Target*>::Node* i = activeTargets.getFirst(); i; i = i->getNext())
+    {
+      this->activeTargets.append(i->data);
+      for(List<Rule>::Node* j = i->data->rules.getFirst(); j; j = j->getNext())
+      {
+        Rule& rule = j->data;
+        for(List<String>::Node* i = rule.outputs.getFirst(); i; i = i->getNext())
+        {
+          Map<String, Rule*>::Node* node = this->outputToRule.find(i->data);
+          if(!node)
+          {
+            this->outputToRule.append(i->data, &rule);
+            continue;
+          }
+
+          // a rule of another configuration creates the same output file, so that the rules must not be executed at once
+          Rule* dependency = node->data;
+          if(dependency != &rule && !rule.ruleDependencies.find(dependency) && !dependency->ruleDependencies.find(&rule))
+          {
+            rule.ruleDependencies.append(dependency, String());
+            dependency->rulePropagations.append(&rule, String());
+          }
+        }
+      }
+    }
   }
   
-  bool build(Engine& engine, unsigned int maxParallelJobs, bool clean, bool rebuild, bool showDebug)
+  /** Reads the status of the input and output files of all active rules in one go */
+  void prefetchStatus()
+  {
+    List<String> files;
+    for(List<Target*>::Node* i = activeTargets.getFirst(); i; i = i->getNext())
+      for(List<Rule>::Node* j = i->data->rules.getFirst(); j; j = j->getNext())
+      {
+        const Rule& rule = j->data;
+        for(const List<String>::Node* i = rule.inputs.getFirst(); i; i = i->getNext())
+          files.append(i->data);
+        for(const List<String>::Node* i = rule.outputs.getFirst(); i; i = i->getNext())
+          files.append(i->data);
+      }
+    File::prefetchStatus(files);
+  }
+
+  /**
+  * Determines the length of the longest chain of rules that starts with a given rule (the critical path). The
+  * length is measured in the execution times of the previous run or in a default duration if a rule was not
+  * executed before.
+  */
+  long long getCriticalPath(Rule& rule, long long defaultDuration)
+  {
+    if(rule.criticalPath >= 0)
+      return rule.criticalPath;
+    rule.criticalPath = 0; // ignore circular dependencies
+    long long longestPath = 0;
+    for(Map<Rule*, String>::Node* i = rule.rulePropagations.getFirst(); i; i = i->getNext())
+    {
+      long long path = getCriticalPath(*i->key, defaultDuration);
+      if(path > longestPath)
+        longestPath = path;
+    }
+    long long duration = 0;
+    if(!rule.outputs.isEmpty())
+    {
+      if(rule.buildState)
+        duration = rule.buildState->getDuration(rule.outputs.getFirst()->data);
+      if(!duration)
+        duration = defaultDuration;
+    }
+    rule.criticalPath = duration + longestPath;
+    return rule.criticalPath;
+  }
+
+  /**
+  * Determines the scheduling priority of a rule. Rules on the critical path of the build are started first. Without
+  * execution times of a previous run, the priority depends on the number of rules and the number of dependent rules
+  * that follow a rule.
+  */
+  long long getPriority(Rule& rule, long long defaultDuration)
+  {
+    return getCriticalPath(rule, defaultDuration) + rule.rulePropagations.getSize();
+  }
+
+  /**
+  * Samples the load of the system
+  * @param checkPressure Whether a cpu pressure of at least 50% should be reported
+  * @param load The load average or \c 0 if it is unknown
+  * @return Whether the cpu pressure is too high
+  */
+  static bool sampleLoad(bool checkPressure, double& load)
+  {
+    if(!Process::getLoadAverage(load))
+      load = 0.;
+    double pressure;
+    return checkPressure && Process::getCpuPressure(pressure) && pressure >= 50.;
+  }
+
+  bool build(Engine& engine, unsigned int maxParallelJobs, unsigned int maxRemoteJobs, double maxLoad, unsigned long long memoryBudget, Trace* trace, Stats* stats, bool clean, bool rebuild, bool keepGoing, bool fastFail, bool showDebug)
   {
-    List<Rule*> pendingJobs;
+    // use the average execution time of the previous run for rules that were not executed before
+    long long totalDuration = 0;
+    unsigned int knownDurations = 0;
+    for(List<Target*>::Node* i = activeTargets.getFirst(); i; i = i->getNext())
+      for(List<Rule>::Node* j = i->data->rules.getFirst(); j; j = j->getNext())
+      {
+        const Rule& rule = j->data;
+        if(rule.buildState && !rule.outputs.isEmpty())
+        {
+          long long duration = rule.buildState->getDuration(rule.outputs.getFirst()->data);
+          if(duration)
+          {
+            totalDuration += duration;
+            ++knownDurations;
+          }
+        }
+      }
+    long long defaultDuration = knownDurations ? totalDuration / knownDurations : 1000;
+
+    // use the number of usable processors as automatic load limit (and also check the cpu pressure)
+    bool checkPressure = false;
+    if(maxLoad < 0.)
+    {
+      checkPressure = true;
+      maxLoad = Process::getProcessorCount();
+    }
+
+    Heap<Rule*> pendingJobs;
     for(List<Target*>::Node* i = activeTargets.getFirst(); i; i = i->getNext())
       for(List<Rule>::Node* j = i->data->rules.getFirst(); j; j = j->getNext())
         if(j->data.ruleDependencies.isEmpty())
-          pendingJobs.append(&j->data);
+          pendingJobs.append(getPriority(j->data, defaultDuration), &j->data);
     
+    // use the available memory as default memory budget
+    if(!memoryBudget)
+      Process::getAvailableMemory(memoryBudget);
+    unsigned long long usedMemory = 0;
+
     Map<unsigned int, Rule*> runningJobs;
+    unsigned int runningRemoteJobs = 0; /**< The number of running jobs whose commands are executed by a worker */
+    List<unsigned int> freeSlots;
+    unsigned int usedSlots = 0;
+    Heap<Rule*> localPendingJobs; /**< Rules that have to be executed locally and wait for a free local slot */
+    Heap<Rule*> memoryWaitingJobs; /**< Rules that wait for running rules to release memory */
     bool failure = false;
+    unsigned int failedRules = 0;
+    unsigned int abortedRules = 0;
     do
     {
       Rule* rule;
-
-      if(!failure)
-        while(runningJobs.getSize() < maxParallelJobs && !pendingJobs.isEmpty())
+      bool failed = false;
+
+      bool overloaded = false;
+      bool loadSampled = false; // the system load is sampled at most once per pass
+      bool pressure = false;
+      double load = 0.;
+      if(!failure || keepGoing)
+        for(;;)
         {
-          rule = pendingJobs.getFirst()->data;
-          pendingJobs.removeFirst();
+          // send compile rules to the worker while it has free slots (the local limits do not apply to them)
+          // and move the other rules into a separate heap while no local slot is free (or the system is too busy)
+          unsigned int localJobs = runningJobs.getSize() - runningRemoteJobs;
+          bool localSlotFree = localJobs < maxParallelJobs && !overloaded;
+          Heap<Rule*>* jobs;
+          if(localSlotFree && !localPendingJobs.isEmpty() &&
+             (pendingJobs.isEmpty() || localPendingJobs.getFirstPriority() >= pendingJobs.getFirstPriority()))
+          {
+            jobs = &localPendingJobs;
+            rule = localPendingJobs.getFirst();
+          }
+          else if(!pendingJobs.isEmpty() && (localSlotFree || runningRemoteJobs < maxRemoteJobs))
+          {
+            jobs = &pendingJobs;
+            rule = pendingJobs.getFirst();
+            rule->remote = !rule->localRetry && runningRemoteJobs < maxRemoteJobs && rule->isRemoteCandidate();
+            if(!rule->remote && !localSlotFree)
+            {
+              pendingJobs.removeFirst();
+              localPendingJobs.append(getPriority(*rule, defaultDuration), rule);
+              continue;
+            }
+          }
+          else
+            break;
+          if(!rule->remote && maxLoad != 0. && localJobs)
+          {
+            if(!loadSampled)
+            {
+              pressure = sampleLoad(checkPressure, load);
+              loadSampled = true;
+            }
+            if(pressure || (load < localJobs ? localJobs : load) >= maxLoad) // the load average reacts slowly to recently started processes
+            {
+              overloaded = true;
+              continue;
+            }
+          }
+          jobs->removeFirst();
+          if(rule->pool && rule->pool->depth && rule->pool->runningJobs >= rule->pool->depth)
+          {
+            rule->pool->waitingJobs.append(getPriority(*rule, defaultDuration), rule);
+            continue;
+          }
+          unsigned long long memory = rule->remote ? 0 : rule->getMemoryEstimate();
+          if(!rule->remote && memoryBudget && localJobs && usedMemory + memory > memoryBudget)
+          {
+            memoryWaitingJobs.append(getPriority(*rule, defaultDuration), rule);
+            continue;
+          }
           unsigned int pid;
-          if(!rule->startExecution(pid))
+          long long checkStartTime = trace ? Clock::getMicroseconds() : 0;
+          bool started = rule->localRetry ? rule->continueExecution(pid) : rule->startExecution(pid);
+          if(trace)
+            trace->addEvent("check", rule->name, checkStartTime, Clock::getMicroseconds());
+          if(!started)
           {
-            failure = true;
+            ++failedRules;
+            failed = true;
             goto finishedRuleExecution;
           }
           if(pid)
+          {
             runningJobs.append(pid, rule);
+            if(rule->remote)
+              ++runningRemoteJobs;
+            if(freeSlots.isEmpty())
+              rule->slot = ++usedSlots;
+            else
+            {
+              rule->slot = freeSlots.getFirst()->data;
+              freeSlots.removeFirst();
+            }
+            rule->reservedMemory = memory;
+            usedMemory += memory;
+            if(rule->pool)
+            {
+              rule->reservedPool = rule->pool;
+              ++rule->pool->runningJobs;
+            }
+          }
           else
             goto finishedRuleExecution;
         }
 
       if(!runningJobs.isEmpty())
       {
-        unsigned int pid = Process::waitOne();
+        unsigned int pid = Process::waitOne(overloaded ? 500 : -1); // check the system load again in a while
         Map<unsigned int, Rule*>::Node* job = runningJobs.find(pid);
         if(!job)
           continue;
         rule = job->data;
         runningJobs.remove(job);
+        if(failure && fastFail && !rule->isRunningLastCommand())
+        {
+          rule->abortExecution();
+          ++abortedRules;
+          failed = true;
+          goto finishedRuleExecution;
+        }
         if(!rule->continueExecution(pid))
         {
-          failure = true;
+          if(failure && fastFail) // the command was terminated (a rule whose last command succeeded is finished normally)
+          {
+            rule->abortExecution();
+            ++abortedRules;
+          }
+          else
+            ++failedRules;
+          failed = true;
           goto finishedRuleExecution;
         }
         if(pid)
@@ -573,6 +1197,62 @@ public:
       continue;
 
     finishedRuleExecution:
+      usedMemory -= rule->reservedMemory;
+      rule->reservedMemory = 0;
+      if(rule->reservedPool)
+      {
+        Pool& pool = *rule->reservedPool;
+        --pool.runningJobs;
+        rule->reservedPool = 0;
+        if(!pool.waitingJobs.isEmpty())
+        {
+          Rule* waitingRule = pool.waitingJobs.removeFirst();
+          pendingJobs.append(getPriority(*waitingRule, defaultDuration), waitingRule);
+        }
+      }
+      if(rule->slot)
+      {
+        freeSlots.append(rule->slot);
+        rule->slot = 0;
+        if(rule->remote)
+          --runningRemoteJobs;
+        else if(!memoryWaitingJobs.isEmpty())
+        {
+          // let waiting rules try again as far as their memory estimates fit into the free memory (but at least one)
+          unsigned long long freeMemory = usedMemory < memoryBudget ? memoryBudget - usedMemory : 0;
+          do
+          {
+            Rule* waitingRule = memoryWaitingJobs.removeFirst();
+            pendingJobs.append(getPriority(*waitingRule, defaultDuration), waitingRule);
+            unsigned long long memory = waitingRule->getMemoryEstimate();
+            if(memory >= freeMemory)
+              break;
+            freeMemory -= memory;
+          } while(!memoryWaitingJobs.isEmpty());
+        }
+      }
+      if(rule->localRetry)
+      {
+        rule->remote = false;
+        localPendingJobs.append(getPriority(*rule, defaultDuration), rule);
+        continue;
+      }
+      if(stats)
+        stats->addRule(rule->rebuild);
+      if(failed)
+      {
+        if(!failure)
+        {
+          failure = true;
+          if(fastFail)
+          {
+            // terminate all running commands
+            for(Map<unsigned int, Rule*>::Node* i = runningJobs.getFirst(); i; i = i->getNext())
+              i->data->process.kill();
+          }
+        }
+        continue; // the rules depending on the failed rule are skipped
+      }
       ++finishedRules;
       for(Map<Rule*, String>::Node* i = rule->rulePropagations.getFirst(); i; i = i->getNext())
       {
@@ -580,17 +1260,22 @@ public:
         ASSERT(!rule.ruleDependencies.isEmpty());
         ++rule.finishedRuleDependencies;
         if(rule.finishedRuleDependencies == rule.ruleDependencies.getSize())
-        {
-          if(rule.rulePropagations.isEmpty())
-            pendingJobs.append(&rule);
-          else
-            pendingJobs.prepend(&rule);
-        }
+          pendingJobs.append(getPriority(rule, defaultDuration), &rule);
       }
-    } while(!runningJobs.isEmpty() || (!pendingJobs.isEmpty() && !failure));
+    } while(!runningJobs.isEmpty() || ((!pendingJobs.isEmpty() || !localPendingJobs.isEmpty()) && (!failure || keepGoing)));
 
     if(failure)
+    {
+      if(keepGoing || fastFail)
+      {
+        String message = String().format(256, "%u rule(s) failed", failedRules);
+        if(abortedRules)
+          message.append(String().format(256, ", %u rule(s) were terminated", abortedRules));
+        message.append(String().format(256, ", %u rule(s) were skipped", activeRules - finishedRules - failedRules - abortedRules));
+        engine.error(message);
+      }
       return false;
+    }
 
     // unresolvable dependencies?
     if(finishedRules < activeRules)
@@ -603,17 +1288,540 @@ public:
   }
 };
 
-bool Mare::buildTargets(const String& platform, const String& configuration)
+bool Mare::buildFile(GraphCache* graphCache)
 {
+  // enter root key
+  engine.enterRootKey();
+
+  // read default or check input platform names
+  VERIFY(engine.enterKey("platforms"));
+  if(inputPlatforms.isEmpty())
+  {
+    String firstPlatform = engine.getFirstKey();
+    if(!firstPlatform.isEmpty())
+      inputPlatforms.append(firstPlatform);
+    else
+    {
+      engine.error("cannot find any platforms");
+      return false;
+    }
+  }
+  else
+    for(const List<String>::Node* i = inputPlatforms.getFirst(); i; i = i->getNext())
+      if(!engine.hasKey(i->data))
+      {
+        engine.error(String().format(256, "cannot find platform \"%s\"", i->data.getData()));
+        return false;
+      }
+  engine.leaveKey();
+
+  // read default or check input configuration names
+  VERIFY(engine.enterKey("configurations"));
+  if(inputConfigs.isEmpty())
+  {
+    String firstConfiguration = engine.getFirstKey();
+    if(!firstConfiguration.isEmpty())
+      inputConfigs.append(firstConfiguration);
+    else
+    {
+      engine.error("cannot find any configurations");
+      return false;
+    }
+  }
+  else
+    for(const List<String>::Node* i = inputConfigs.getFirst(); i; i = i->getNext())
+      if(!engine.hasKey(i->data))
+      {
+        engine.error(String().format(256, "cannot find configuration \"%s\"", i->data.getData()));
+        return false;
+      }
+  engine.leaveKey();
+
+  // read default or check input target names
+  VERIFY(engine.enterKey("targets"));
+  engine.getKeys(allTargets);
+  if(inputTargets.isEmpty())
+  {
+    if(!allTargets.isEmpty())
+      inputTargets.append(allTargets.getFirst()->data);
+    else
+    {
+      engine.error("cannot find any targets");
+      return false;
+    }
+  }
+  else
+    for(const List<String>::Node* i = inputTargets.getFirst(); i; i = i->getNext())
+      if(!engine.hasKey(i->data))
+      {
+        engine.error(String().format(256, "cannot find target \"%s\"", i->data.getData()));
+        return false;
+      }
+  engine.leaveKey();
+
+  // leave root key
+  engine.leaveKey(); 
+
+  // build input targets (with dependencies) of all input configurations at once
   RuleSet ruleSet;
+  for(const List<String>::Node* i = inputPlatforms.getFirst(); i; i = i->getNext())
+  {
+    const String& platform = i->data;
+    for(const List<String>::Node* i = inputConfigs.getFirst(); i; i = i->getNext())
+    {
+      const String& configuration = i->data;
+      if(!readTargets(ruleSet, platform, configuration))
+        return false;
+    }
+  }
+
+  if(!engine.saveGlobs(GraphCache::getGlobsFile()) && showDebug)
+    printf("debug: Cannot store the results of the wildcard expansions\n");
+
+  // store the rule graph for the next build (unless the marefile has side effects)
+  if(graphCache && !engine.hasWrittenFiles())
+  {
+    String graph;
+    writeGraph(ruleSet, graph);
+    if(!graphCache->save(engine, graph) && showDebug)
+      printf("debug: Cannot store the rule graph of \"%s\"\n", inputFile.getData());
+  }
+
+  return buildRules(ruleSet);
+}
+
+bool Mare::buildCachedGraph(GraphCache& graphCache, bool& result)
+{
+  long long startTime = Clock::getMicroseconds();
+  String graph;
+  RuleSet ruleSet;
+  if(!graphCache.load(graph) || !readGraph(ruleSet, graph))
+    return false;
+  long long endTime = Clock::getMicroseconds();
+  if(trace)
+    trace->addEvent("graph", inputFile, startTime, endTime);
+  if(stats)
+    stats->addEvaluationTime(endTime - startTime);
+  if(showDebug)
+    printf("debug: Using the cached rule graph of \"%s\"\n", inputFile.getData());
+  result = buildRules(ruleSet);
+  return true;
+}
+
+/** Writes a file that is generated by mare if its content has changed */
+static void writeGeneratedFile(const String& path, const String& content)
+{
+  String oldContent;
+  File file;
+  if(file.open(path))
+  {
+    char buffer[4096];
+    size_t n;
+    while((n = file.read(buffer, sizeof(buffer))) > 0)
+      oldContent.append(buffer, n);
+    file.close();
+  }
+  if(oldContent == content && File::exists(path))
+    return;
+  Directory::create(File::getDirname(path));
+  if(!file.open(path, File::writeFlag) || !file.write(content))
+    printf("warning: Cannot write file \"%s\": %s\n", path.getData(), Error::getString().getData());
+  file.close();
+  File::invalidateStatus(path);
+}
+
+void Mare::writeGraph(RuleSet& ruleSet, String& graph)
+{
+  GraphCache::Writer writer;
+  writer.write((unsigned int)ruleSet.pools.getSize());
+  for(const Map<String, Pool>::Node* i = ruleSet.pools.getFirst(); i; i = i->getNext())
+  {
+    writer.write(i->key);
+    writer.write(i->data.depth);
+  }
+  writer.write((unsigned int)generatedFiles.getSize());
+  for(const Map<String, String>::Node* i = generatedFiles.getFirst(); i; i = i->getNext())
+  {
+    writer.write(i->key);
+    writer.write(i->data);
+  }
+  writer.write((unsigned int)ruleSet.targetSets.getSize());
+  for(const List<TargetSet>::Node* i = ruleSet.targetSets.getFirst(); i; i = i->getNext())
+  {
+    const Map<String, Target>& targets = i->data.targets;
+    List<String> activeTargets;
+    for(const List<Target*>::Node* j = i->data.activeTargets.getFirst(); j; j = j->getNext())
+      for(const Map<String, Target>::Node* k = targets.getFirst(); k; k = k->getNext())
+        if(&k->data == j->data)
+        {
+          activeTargets.append(k->key);
+          break;
+        }
+    writer.write(activeTargets);
+    writer.write((unsigned int)targets.getSize());
+    for(const Map<String, Target>::Node* j = targets.getFirst(); j; j = j->getNext())
+    {
+      const Target& target = j->data;
+      writer.write(j->key);
+      String stateFile;
+      for(const Map<String, BuildState>::Node* k = ruleSet.buildStates.getFirst(); k; k = k->getNext())
+        if(&k->data == target.rule->buildState)
+          stateFile = k->key;
+      writer.write(stateFile);
+      writer.write((unsigned int)target.rules.getSize());
+      for(const List<Rule>::Node* k = target.rules.getFirst(); k; k = k->getNext())
+      {
+        const Rule& rule = k->data;
+        writer.write(rule.name);
+        writer.write(rule.dependencies);
+        writer.write(rule.declaredInputs);
+        unsigned int count = 0;
+        for(const List<String>::Node* l = rule.inputs.getFirst(); l && count < rule.declaredInputs; l = l->getNext(), ++count)
+          writer.write(l->data);
+        writer.write(rule.outputs);
+        writer.write(rule.command);
+        writer.write(rule.message);
+        writer.write(rule.memory);
+        String pool;
+        for(const Map<String, Pool>::Node* l = ruleSet.pools.getFirst(); l; l = l->getNext())
+          if(&l->data == rule.pool)
+            pool = l->key;
+        writer.write(pool);
+        writer.write((unsigned int)rule.restat);
+        writer.write(rule.depfile);
+      }
+    }
+  }
+  graph = writer.data;
+}
+
+bool Mare::readGraph(RuleSet& ruleSet, const String& graph)
+{
+  GraphCache::Reader reader(graph);
+  unsigned int count;
+  if(!reader.read(count))
+    return false;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    String name;
+    unsigned int depth;
+    if(!reader.read(name) || !reader.read(depth))
+      return false;
+    ruleSet.pools.append(name).depth = depth;
+  }
+
+  // restore the generated files (in case they were deleted)
+  if(!reader.read(count))
+    return false;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    String file, content;
+    if(!reader.read(file) || !reader.read(content))
+      return false;
+    writeGeneratedFile(file, content);
+  }
+
+  unsigned int targetSets;
+  if(!reader.read(targetSets))
+    return false;
+  for(unsigned int i = 0; i < targetSets; ++i)
+  {
+    TargetSet& targetSet = ruleSet.targetSets.append();
+    List<String> activeTargets;
+    unsigned int targets;
+    if(!reader.read(activeTargets) || !reader.read(targets))
+      return false;
+    for(unsigned int j = 0; j < targets; ++j)
+    {
+      String name, stateFile;
+      unsigned int rules;
+      if(!reader.read(name) || !reader.read(stateFile) || !reader.read(rules) || !rules)
+        return false;
+      Target& target = targetSet.targets.append(name);
+
+      // load the state database of the build directory
+      BuildState* buildState = 0;
+      if(!stateFile.isEmpty())
+      {
+        Map<String, BuildState>::Node* node = ruleSet.buildStates.find(stateFile);
+        if(node)
+          buildState = &node->data;
+        else
+        {
+          buildState = &ruleSet.buildStates.append(stateFile);
+          buildState->load(stateFile);
+        }
+      }
+
+      for(unsigned int k = 0; k < rules; ++k)
+      {
+        Rule& rule = target.rules.append();
+        rule.builder = this;
+        rule.target = &target;
+        rule.buildState = buildState;
+        String pool;
+        unsigned int restat;
+        if(!reader.read(rule.name) || !reader.read(rule.dependencies) || !reader.read(rule.inputs) || !reader.read(rule.outputs) ||
+           !reader.read(rule.command) || !reader.read(rule.message) || !reader.read(rule.memory) || !reader.read(pool) ||
+           !reader.read(restat) || !reader.read(rule.depfile))
+          return false;
+        rule.declaredInputs = rule.inputs.getSize();
+        if(!pool.isEmpty())
+        {
+          Map<String, Pool>::Node* node = ruleSet.pools.find(pool);
+          if(!node)
+            return false;
+          rule.pool = &node->data;
+        }
+        rule.restat = restat != 0;
+        if(!rule.depfile.isEmpty())
+          rule.addDepfileInputs();
+      }
+      target.rule = &target.rules.getLast()->data;
+    }
+
+    // activate the targets in the order in which they were activated when the graph was stored
+    for(const List<String>::Node* j = activeTargets.getFirst(); j; j = j->getNext())
+    {
+      Map<String, Target>::Node* node = targetSet.targets.find(j->data);
+      if(!node)
+        return false;
+      node->data.active = true;
+      targetSet.activeTargets.append(&node->data);
+    }
+    ruleSet.resolveDependencies(targetSet, !ignoreDependencies);
+  }
+  return true;
+}
+
+static const unsigned int defaultUnitySize = 8; /**< The number of source files in a unity source file if the "unity" key has no value */
+
+/** Returns the keys that affect the compilation of a C++ source file (to find source files with individual settings) */
+static String getCompileSettings(Engine& engine)
+{
+  static const char* keys[] = {"cppFlags", "defines", "includePaths"};
+  String result;
+  for(size_t i = 0; i < sizeof(keys) / sizeof(*keys); ++i)
+  {
+    List<String> values;
+    engine.getKeys(String(keys[i], -1), values);
+    result.append(Mare::join(values));
+    result.append('\n');
+  }
+  return result;
+}
+
+/** Returns whether a rule is the compile rule of a C++ source file with an object file and a dependency file as output files (like "cppSource") */
+static bool isUnityCandidate(const Rule& rule)
+{
+  String extension = File::getExtension(rule.name);
+  if(extension != "cpp" && extension != "cc" && extension != "cxx" && extension != "c++" && extension != "C")
+    return false;
+  return !rule.depfile.isEmpty() && rule.outputs.getSize() == 2 && rule.outputs.getLast()->data == rule.depfile && !rule.command.isEmpty();
+}
+
+/**
+* Replaces words of a command line
+* @param line The command line
+* @param replacements The replacement of each word that has to be replaced (or an empty string to remove the word)
+* @return The number of replaced words
+*/
+static unsigned int replaceWords(String& line, const Map<String, String>& replacements)
+{
+  List<Word> words;
+  Word::split(line, words);
+  unsigned int count = 0;
+  for(List<Word>::Node* i = words.getFirst(), * next; i; i = next)
+  {
+    next = i->getNext();
+    const Map<String, String>::Node* replacement = replacements.find(i->data);
+    if(!replacement)
+      continue;
+    if(replacement->data.isEmpty())
+      words.remove(i);
+    else
+      i->data = replacement->data;
+    ++count;
+  }
+  if(count)
+  {
+    line.clear();
+    Word::append(words, line);
+  }
+  return count;
+}
+
+/** Returns a path to a file relative to a directory (or an absolute path if there is none) */
+static String getPathFrom(const String& dir, const String& file)
+{
+  if(File::isPathAbsolute(file))
+    return file;
+  String absoluteFile = Directory::getCurrent() + "/" + file;
+  if(File::isPathAbsolute(dir))
+    return absoluteFile;
+  String result;
+  String simpleDir = File::simplifyPath(dir);
+  for(const char* str = simpleDir.getData(); *str;)
+  {
+    const char* end = strchr(str, '/');
+    size_t length = end ? end - str : strlen(str);
+    if(length == 2 && strncmp(str, "..", 2) == 0)
+      return absoluteFile;
+    if(!(length == 1 && *str == '.') && length > 0)
+      result.append("../");
+    str += length;
+    if(*str)
+      ++str;
+  }
+  result.append(file);
+  return result;
+}
+
+void Mare::groupUnitySources(Target& target, List<List<Rule>::Node*>& sources, unsigned int unitySize, Map<String, String>& objects)
+{
+  // group the source files by directory
+  Map<String, List<List<Rule>::Node*> > dirs;
+  for(List<List<Rule>::Node*>::Node* i = sources.getFirst(); i; i = i->getNext())
+  {
+    String dir = File::getDirname(i->data->data.name);
+    Map<String, List<List<Rule>::Node*> >::Node* node = dirs.find(dir);
+    List<List<Rule>::Node*>& dirSources = node ? node->data : dirs.append(dir);
+    dirSources.append(i->data);
+  }
+
+  Map<String, unsigned int> unitCounts; /**< The number of unity source files in each object file directory */
+  for(Map<String, List<List<Rule>::Node*> >::Node* i = dirs.getFirst(); i; i = i->getNext())
+    for(List<List<Rule>::Node*>::Node* j = i->data.getFirst(); j;)
+    {
+      List<List<Rule>::Node*> unit;
+      for(; j && unit.getSize() < unitySize; j = j->getNext())
+        unit.append(j->data);
+      if(unit.getSize() < 2)
+        continue;
+
+      // derive the compile rule of the unity source file from the rule of its first source file
+      const Rule& first = unit.getFirst()->data->data;
+      const String& firstObject = first.outputs.getFirst()->data;
+      String objectDir = File::getDirname(firstObject);
+      Map<String, unsigned int>::Node* unitCount = unitCounts.find(objectDir);
+      unsigned int unitIndex = unitCount ? ++unitCount->data : (unitCounts.append(objectDir, 1), 1);
+      String unitName = objectDir + String().format(32, "/__unity%u", unitIndex);
+      String unitSource = unitName + "." + File::getExtension(first.name);
+      String unitObject = unitName + "." + File::getExtension(firstObject);
+      String unitDepfile = unitName + "." + File::getExtension(first.depfile);
+      Map<String, String> replacements;
+      replacements.append(first.name, unitSource);
+      replacements.append(firstObject, unitObject);
+      replacements.append(first.depfile, unitDepfile);
+      List<String> command;
+      unsigned int replacedWords = 0;
+      for(const List<String>::Node* k = first.command.getFirst(); k; k = k->getNext())
+      {
+        String& line = command.append(k->data);
+        replacedWords += replaceWords(line, replacements);
+      }
+      if(replacedWords < 2) // the command does not use the file names (like the "cppSource" rule)
+      {
+        if(showDebug)
+          printf("debug: Cannot derive a unity build command from the rule for \"%s\"\n", first.name.getData());
+        continue;
+      }
+
+      // write the unity source file (if its content has changed)
+      String content;
+      for(List<List<Rule>::Node*>::Node* k = unit.getFirst(); k; k = k->getNext())
+      {
+        content.append("#include \"");
+        content.append(getPathFrom(objectDir, k->data->data.name));
+        content.append("\"\n");
+      }
+      if(clean && !rebuild)
+        File::unlink(unitSource);
+      else
+      {
+        writeGeneratedFile(unitSource, content);
+        generatedFiles.append(unitSource, content);
+      }
+
+      Rule& rule = target.rules.append();
+      rule.builder = this;
+      rule.target = &target;
+      rule.buildState = first.buildState;
+      rule.name = unitSource;
+      rule.inputs.append(unitSource);
+      rule.outputs.append(unitObject);
+      rule.outputs.append(unitDepfile);
+      rule.command = command;
+      if(!first.message.isEmpty())
+        rule.message.append(unitSource);
+      rule.memory = first.memory;
+      rule.pool = first.pool;
+      rule.restat = first.restat;
+      rule.depfile = unitDepfile;
+      for(List<List<Rule>::Node*>::Node* k = unit.getFirst(); k; k = k->getNext())
+      {
+        const Rule& source = k->data->data;
+        rule.inputs.append(source.name);
+        objects.append(source.outputs.getFirst()->data, k == unit.getFirst() ? unitObject : String());
+      }
+      rule.declaredInputs = rule.inputs.getSize();
+      rule.addDepfileInputs();
+      if(showDebug)
+        printf("debug: Building %u source files of \"%s\" with \"%s\"\n", unit.getSize(), i->key.getData(), unitSource.getData());
+
+      for(List<List<Rule>::Node*>::Node* k = unit.getFirst(); k; k = k->getNext())
+        target.rules.remove(k->data);
+    }
+}
+
+bool Mare::readTargets(RuleSet& ruleSet, const String& platform, const String& configuration)
+{
+  TargetSet& targetSet = ruleSet.targetSets.append();
 
   Map<String, void*> activateTargets;
   for(const List<String>::Node* i = inputTargets.getFirst(); i; i = i->getNext())
     activateTargets.append(i->data, 0);
 
+  // read the job pools
+  {
+    engine.enterUnnamedKey();
+    engine.addDefaultKey("platform", platform);
+    engine.addDefaultKey(platform, platform);
+    engine.addDefaultKey("configuration", configuration);
+    engine.addDefaultKey(configuration, configuration);
+    engine.enterRootKey();
+    if(engine.enterKey("pools"))
+    {
+      List<String> pools;
+      engine.getKeys(pools);
+      for(List<String>::Node* i = pools.getFirst(); i; i = i->getNext())
+      {
+        if(ruleSet.pools.find(i->data))
+          continue; // the pools are shared by all configurations
+        Pool& pool = ruleSet.pools.append(i->data);
+        VERIFY(engine.enterKey(i->data));
+        String depth = engine.getFirstKey("depth", false);
+        if(!depth.isEmpty())
+        {
+          char* end;
+          long value = strtol(depth.getData(), &end, 10);
+          if(*end || value < 0)
+            printf("warning: Pool \"%s\" has an invalid depth \"%s\"\n", i->data.getData(), depth.getData());
+          else
+            pool.depth = (unsigned int)value;
+        }
+        engine.leaveKey();
+      }
+      engine.leaveKey();
+    }
+    engine.leaveKey();
+    engine.leaveKey();
+  }
+
   List<String> files;
   for(List<String>::Node* i = allTargets.getFirst(); i; i = i->getNext())
   {
+    long long evaluationStartTime = Clock::getMicroseconds();
     engine.enterUnnamedKey();
     engine.addDefaultKey("platform", platform);
     engine.addDefaultKey(platform, platform);
@@ -630,13 +1838,59 @@ bool Mare::buildTargets(const String& platform, const String& configuration)
     }
     engine.addDefaultKey("mareDir", engine.getMareDir());
 
-    Target& target = ruleSet.targets.append(i->data);
+    Target& target = targetSet.targets.append(i->data);
     if(activateTargets.find(i->data))
     {
       target.active = true;
-      ruleSet.activeTargets.append(&target);
+      targetSet.activeTargets.append(&target);
+    }
+
+    // load the state database of the build directory
+    BuildState* buildState = 0;
+    {
+      String buildDir = engine.getFirstKey("buildDir", true);
+      String stateFile = buildDir.isEmpty() ? String(".mare_state") : buildDir + "/.mare_state";
+      if(!clean || rebuild)
+      {
+        Map<String, BuildState>::Node* node = ruleSet.buildStates.find(stateFile);
+        if(node)
+          buildState = &node->data;
+        else
+        {
+          buildState = &ruleSet.buildStates.append(stateFile);
+          buildState->load(stateFile);
+          if(clean)
+            buildState->clear();
+        }
+      }
+      else
+        File::unlink(stateFile);
     }
     
+    // read the settings of the unity build
+    unsigned int unitySize = 0;
+    Map<String, void*> unityExclude;
+    String unitySettings;
+    {
+      List<String> unity;
+      if(engine.getKeys("unity", unity))
+      {
+        if(unity.isEmpty() || unity.getFirst()->data.isEmpty())
+          unitySize = defaultUnitySize;
+        else
+          unitySize = (unsigned int)strtoul(unity.getFirst()->data.getData(), 0, 10);
+      }
+      if(unitySize > 1)
+      {
+        List<String> files;
+        engine.getKeys("unityExclude", files);
+        for(const List<String>::Node* i = files.getFirst(); i; i = i->getNext())
+          unityExclude.append(i->data, 0);
+        unitySettings = getCompileSettings(engine);
+      }
+    }
+    List<List<Rule>::Node*> unitySources;
+
     // add rule for each source file
     if(engine.enterKey("files"))
     {
@@ -647,41 +1901,116 @@ bool Mare::buildTargets(const String& platform, const String& configuration)
         Rule& rule = target.rules.append();
         rule.builder = this;
         rule.target = &target;
+        rule.buildState = buildState;
         rule.name = i->data;
         engine.enterUnnamedKey();
         engine.addDefaultKey("file", i->data);
         VERIFY(engine.enterKey(i->data));
         engine.getKeys("dependencies", rule.dependencies, false);
         engine.getKeys("input", rule.inputs, false);
+        rule.declaredInputs = rule.inputs.getSize();
         engine.getKeys("output", rule.outputs, false);
         engine.getText("command", rule.command, false);
         engine.getText("message", rule.message, false);
+        rule.readMemory(engine);
+        if(!rule.readPool(engine, ruleSet.pools))
+          return false;
+        rule.restat = !engine.getFirstKey("restat", false).isEmpty();
+        rule.readDepfile(engine);
+        if(unitySize > 1 && isUnityCandidate(rule) && !unityExclude.find(rule.name) && getCompileSettings(engine) == unitySettings)
+          unitySources.append(target.rules.getLast());
         engine.leaveKey(); // VERIFY(engine.enterKey(i->data));
         engine.leaveKey();
       }
       engine.leaveKey();
     }
 
+    // replace the grouped source files with unity source files
+    Map<String, String> unityObjects;
+    if(!unitySources.isEmpty())
+      groupUnitySources(target, unitySources, unitySize, unityObjects);
+
     // add rule for target file
     Rule& rule = target.rules.append();
     rule.builder = this;
     rule.target = &target;
+    rule.buildState = buildState;
     rule.name = i->data;
     target.rule = &rule;
     engine.getKeys("dependencies", rule.dependencies, false);
     engine.getKeys("input", rule.inputs, false);
+    rule.declaredInputs = rule.inputs.getSize();
     engine.getKeys("output", rule.outputs, false);
     engine.getText("command", rule.command, false);
     engine.getText("message", rule.message, false);
+    rule.readMemory(engine);
+    if(!rule.readPool(engine, ruleSet.pools))
+      return false;
+    rule.restat = !engine.getFirstKey("restat", false).isEmpty();
+    rule.readDepfile(engine);
+    if(!unityObjects.isEmpty())
+    {
+      // link the object files of the unity source files instead of the object files of the grouped source files
+      for(List<String>::Node* i = rule.inputs.getFirst(), * next; i; i = next)
+      {
+        next = i->getNext();
+        const Map<String, String>::Node* object = unityObjects.find(i->data);
+        if(!object)
+          continue;
+        if(object->data.isEmpty())
+        {
+          rule.inputs.remove(i);
+          --rule.declaredInputs;
+        }
+        else
+          i->data = object->data;
+      }
+      for(List<String>::Node* i = rule.command.getFirst(); i; i = i->getNext())
+        replaceWords(i->data, unityObjects);
+    }
 
     engine.leaveKey();
     engine.leaveKey();
     engine.leaveKey();
     engine.leaveKey();
+
+    long long evaluationEndTime = Clock::getMicroseconds();
+    if(trace)
+    {
+      Map<String, String> args;
+      args.append("platform", platform);
+      args.append("configuration", configuration);
+      trace->addEvent("evaluate", i->data, evaluationStartTime, evaluationEndTime, 0, &args);
+    }
+    if(stats)
+      stats->addEvaluationTime(evaluationEndTime - evaluationStartTime);
   }
 
-  ruleSet.resolveDependencies(!ignoreDependencies);
-  return ruleSet.build(engine, jobs <= 0 ? (Process::getProcessorCount() - jobs) : jobs, clean, rebuild, showDebug);
+  long long startTime = Clock::getMicroseconds();
+  ruleSet.resolveDependencies(targetSet, !ignoreDependencies);
+  long long endTime = Clock::getMicroseconds();
+  if(trace)
+    trace->addEvent("resolve", "resolveDependencies", startTime, endTime);
+  if(stats)
+    stats->addEvaluationTime(endTime - startTime);
+  return true;
+}
+
+bool Mare::buildRules(RuleSet& ruleSet)
+{
+  long long startTime = Clock::getMicroseconds();
+  File::enableStatusCache(true);
+  if(!clean || rebuild)
+  {
+    ruleSet.prefetchStatus();
+    if(trace)
+      trace->addEvent("stat", "prefetchStatus", startTime, Clock::getMicroseconds());
+  }
+  bool result = ruleSet.build(engine, jobs <= 0 ? (Process::getProcessorCount() - jobs) : jobs, remoteAddress.isEmpty() ? 0 : remoteJobs, maxLoad, memoryBudget, trace, stats, clean, rebuild, keepGoing, fastFail, showDebug);
+  File::enableStatusCache(false);
+  if(stats)
+    stats->addExecutionTime(Clock::getMicroseconds() - startTime);
+  return result;
 }
 
 String Mare::join(const List<String>& words)
@@ -713,3 +2042,40 @@ String Mare::join(const List<String>& words)
   }
   return result;
 }
+
+bool Mare::parseSize(const char* str, unsigned long long& size)
+{
+  char* end;
+  double value = strtod(str, &end);
+  if(end == str || value < 0.)
+    return false;
+  switch(*end)
+  {
+  case 'k':
+  case 'K':
+    value *= 1024.;
+    ++end;
+    break;
+  case 'm':
+  case 'M':
+    value *= 1024. * 1024.;
+    ++end;
+    break;
+  case 'g':
+  case 'G':
+    value *= 1024. * 1024. * 1024.;
+    ++end;
+    break;
+  case 't':
+  case 'T':
+    value *= 1024. * 1024. * 1024. * 1024.;
+    ++end;
+    break;
+  }
+  if(*end == 'b' || *end == 'B')
+    ++end;
+  if(*end)
+    return false;
+  size = (unsigned long long)value;
+  return true;
+}
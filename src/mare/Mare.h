@@ -3,37 +3,79 @@
 
 #include "Tools/List.h"
 #include "Tools/Map.h"
+#include "Tools/String.h"
 
 class Engine;
 class Word;
-class String;
+class Cache;
+class Trace;
+class Stats;
+class RuleSet;
+class Rule;
+class Target;
+class GraphCache;
 
 class Mare
 {
 public:
 
-  Mare(Engine& engine, List<String>& inputPlatforms, List<String>& inputConfigs, List<String>& inputTargets, bool showDebug, bool clean, bool rebuild, int jobs, bool ignoreDependencies) :
-    engine(engine), showDebug(showDebug), clean(clean), rebuild(rebuild), jobs(jobs), ignoreDependencies(ignoreDependencies), inputPlatforms(inputPlatforms), inputConfigs(inputConfigs), inputTargets(inputTargets) {}
+  Mare(Engine& engine, const String& inputFile, List<String>& inputPlatforms, List<String>& inputConfigs, List<String>& inputTargets, bool showDebug, bool clean, bool rebuild, bool keepGoing, bool fastFail, int jobs, double maxLoad, unsigned long long memoryBudget, const String& remoteAddress, const String& remoteWorker, unsigned int remoteJobs, bool ignoreDependencies, bool hashMode, Cache* cache, Trace* trace, Stats* stats) :
+    engine(engine), inputFile(inputFile), showDebug(showDebug), clean(clean), rebuild(rebuild), keepGoing(keepGoing), fastFail(fastFail), jobs(jobs), maxLoad(maxLoad), memoryBudget(memoryBudget), remoteAddress(remoteAddress), remoteWorker(remoteWorker), remoteJobs(remoteJobs), ignoreDependencies(ignoreDependencies), hashMode(hashMode), cache(cache), trace(trace), stats(stats), inputPlatforms(inputPlatforms), inputConfigs(inputConfigs), inputTargets(inputTargets) {}
 
   bool build(const Map<String, String>& userArgs);
 
   static String join(const List<String>& words);
 
+  /**
+  * Parses a size with an optional unit suffix (e.g. "512M" or "4G")
+  * @param str The size string
+  * @param size The size in bytes
+  * @return Whether \c str is a valid size
+  */
+  static bool parseSize(const char* str, unsigned long long& size);
+
 private:
   Engine& engine;
+  String inputFile; /**< The path of the marefile (which is loaded unless the engine has already loaded it) */
   bool showDebug;
   bool clean;
   bool rebuild;
+  bool keepGoing; /**< Whether to continue building the rules that do not depend on a failed rule */
+  bool fastFail; /**< Whether to terminate all running commands when a rule fails */
   int jobs;
+  double maxLoad; /**< The system load limit for starting new processes, \c 0 for no limit or \c -1 for an automatic limit */
+  unsigned long long memoryBudget; /**< The amount of memory that can be used by concurrent processes or \c 0 for the available memory */
+  String remoteAddress; /**< The address of a worker that executes compile commands or an empty string */
+  String remoteWorker; /**< The path to the mare-worker executable that submits commands to the worker */
+  unsigned int remoteJobs; /**< The maximum number of commands that are executed by the worker at once */
   bool ignoreDependencies;
+  bool hashMode;
+  Cache* cache;
+  Trace* trace;
+  Stats* stats;
 
   List<String>& inputPlatforms;
   List<String>& inputConfigs;
   List<String>& inputTargets;
   List<String> allTargets;
+  Map<String, String> generatedFiles; /**< The files that were generated while reading the targets (like unity source files) with their content */
+
+  bool buildFile(GraphCache* graphCache);
+  bool buildCachedGraph(GraphCache& graphCache, bool& result);
+  String getGraphKey(const Map<String, String>& userArgs) const;
+  void writeGraph(RuleSet& ruleSet, String& graph);
+  bool readGraph(RuleSet& ruleSet, const String& graph);
+  bool readTargets(RuleSet& ruleSet, const String& platform, const String& configuration);
+  bool buildRules(RuleSet& ruleSet);
 
-  bool buildFile();
-  bool buildTargets(const String& platform, const String& configuration);
+  /**
+  * Replaces groups of C++ source files of a directory with generated unity source files that include the source files
+  * @param target The target of the source files
+  * @param sources The compile rules of the source files that can be grouped
+  * @param unitySize The maximum number of source files in a group
+  * @param objects Receives the unity object file of the first source file of each group and an empty string for the other ones (by object file of a source file)
+  */
+  void groupUnitySources(Target& target, List<List<Rule>::Node*>& sources, unsigned int unitySize, Map<String, String>& objects);
 
   friend class Rule;
 };
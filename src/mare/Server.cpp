@@ -0,0 +1,485 @@
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef __linux
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+#endif
+
+#include "Tools/Array.h"
+#include "Tools/Error.h"
+#include "Tools/File.h"
+#include "Tools/List.h"
+
+#include "Server.h"
+
+#ifdef __linux
+extern char** environ;
+
+static const char socketFile[] = ".mare_server";
+
+static void terminateHandler(int)
+{
+  unlink(socketFile);
+  _exit(EXIT_FAILURE);
+}
+
+static bool writeAll(int fd, const char* data, size_t size)
+{
+  while(size > 0)
+  {
+    ssize_t i = write(fd, data, size);
+    if(i < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+    data += i;
+    size -= i;
+  }
+  return true;
+}
+
+static bool readAll(int fd, char* data, size_t size)
+{
+  while(size > 0)
+  {
+    ssize_t i = read(fd, data, size);
+    if(i <= 0)
+    {
+      if(i < 0 && errno == EINTR)
+        continue;
+      return false;
+    }
+    data += i;
+    size -= i;
+  }
+  return true;
+}
+
+static int connectSocket()
+{
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd == -1)
+    return -1;
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socketFile);
+  if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/** Checks whether the process on the other end of a connection runs as the same user as this process */
+static bool isPeerTrusted(int fd)
+{
+  struct ucred cred;
+  socklen_t length = sizeof(cred);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) == 0 && cred.uid == geteuid();
+}
+#endif
+
+Server::Server(const String& file, Engine::ErrorHandler errorHandler, void* userData) :
+  file(file), errorHandler(errorHandler), errorUserData(userData), engine(0), socketFd(-1), notifyFd(-1) {}
+
+Server::~Server()
+{
+  delete engine;
+#ifdef __linux
+  if(socketFd != -1)
+  {
+    close(socketFd);
+    unlink(socketFile);
+  }
+  if(notifyFd != -1)
+    close(notifyFd);
+#endif
+}
+
+bool Server::run(BuildFunction build)
+{
+#ifdef __linux
+  // create the socket
+  {
+    int fd = connectSocket();
+    if(fd != -1)
+    {
+      close(fd);
+      errorHandler(errorUserData, String(), -1, "a server is already running in this directory");
+      return false;
+    }
+  }
+  unlink(socketFile);
+  socketFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socketFile);
+  // (the socket is only accessible by the user, since a build runs with the environment sent by the client)
+  if(socketFd == -1 || bind(socketFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || chmod(socketFile, 0600) != 0 ||
+     listen(socketFd, 16) != 0)
+  {
+    errorHandler(errorUserData, String(), -1, String(socketFile) + ": " + Error::getString());
+    return false;
+  }
+  signal(SIGINT, terminateHandler);
+  signal(SIGTERM, terminateHandler);
+  signal(SIGHUP, terminateHandler);
+  signal(SIGPIPE, SIG_IGN);
+
+  // start watching the marefile
+  notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(notifyFd == -1)
+  {
+    errorHandler(errorUserData, String(), -1, Error::getString());
+    return false;
+  }
+  watch(File::getDirname(file));
+  File::enableStatusCache(true);
+  loadEngine();
+  {
+    List<String> newFiles;
+    File::getNewCachedFiles(newFiles);
+  }
+
+  printf("mare: Serving builds in this directory (press Ctrl+C to stop)\n");
+  fflush(stdout);
+
+  for(;;)
+  {
+    int connectionFd = accept4(socketFd, 0, 0, SOCK_CLOEXEC);
+    if(connectionFd == -1)
+    {
+      if(errno == EINTR || errno == ECONNABORTED)
+        continue;
+      errorHandler(errorUserData, String(), -1, Error::getString());
+      return false;
+    }
+    if(!isPeerTrusted(connectionFd))
+    {
+      close(connectionFd);
+      continue;
+    }
+    List<String> usedFiles;
+    int exitCode = serve(connectionFd, build, usedFiles);
+    writeAll(connectionFd, (const char*)&exitCode, sizeof(exitCode));
+    close(connectionFd);
+
+    // read the status of the files used by the build (after watching their directories), so that it is known for the next build
+    readNotifications();
+    List<String> watchedFiles;
+    for(const List<String>::Node* i = usedFiles.getFirst(); i; i = i->getNext())
+      if(watch(File::getDirname(i->data)))
+        watchedFiles.append(i->data);
+    File::prefetchStatus(watchedFiles);
+    List<String> newFiles;
+    File::getNewCachedFiles(newFiles);
+  }
+#else
+  errorHandler(errorUserData, String(), -1, "the build server is not supported on this platform");
+  return false;
+#endif
+}
+
+Engine* Server::getEngine(const String& file)
+{
+  return file == this->file ? engine : 0;
+}
+
+bool Server::forward(int argc, char* argv[], int& exitCode)
+{
+#ifdef __linux
+  // do not send the environment and the console to a server of another user
+  struct stat st;
+  if(lstat(socketFile, &st) != 0 || !S_ISSOCK(st.st_mode) || st.st_uid != geteuid())
+    return false;
+  int fd = connectSocket();
+  if(fd == -1)
+    return false;
+  if(!isPeerTrusted(fd))
+  {
+    close(fd);
+    return false;
+  }
+
+  // send the command line arguments and the environment variables along with the console of the client
+  String request;
+  unsigned int header[2] = {(unsigned int)argc, 0};
+  for(char** env = environ; *env; ++env)
+    ++header[1];
+  for(int i = 0; i < argc; ++i)
+    request.append(argv[i], strlen(argv[i]) + 1);
+  for(char** env = environ; *env; ++env)
+    request.append(*env, strlen(*env) + 1);
+  unsigned int size = (unsigned int)request.getLength();
+
+  char data[sizeof(header) + sizeof(size)];
+  memcpy(data, header, sizeof(header));
+  memcpy(data + sizeof(header), &size, sizeof(size));
+  struct iovec iov = {data, sizeof(data)};
+  int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  fflush(stdout);
+  fflush(stderr);
+  if(sendmsg(fd, &msg, 0) != (ssize_t)sizeof(data) || !writeAll(fd, request.getData(), size))
+  {
+    close(fd);
+    return false;
+  }
+
+  // wait for the exit code
+  if(!readAll(fd, (char*)&exitCode, sizeof(exitCode)))
+  {
+    fprintf(stderr, "%s: lost connection to the build server\n", argv[0]);
+    exitCode = EXIT_FAILURE;
+  }
+  close(fd);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Server::loadEngine()
+{
+  delete engine;
+  engine = new Engine(errorHandler, errorUserData);
+  if(!engine->load(file))
+  {
+    delete engine;
+    engine = 0;
+  }
+}
+
+bool Server::watch(const String& dir)
+{
+#ifdef __linux
+  if(watchedDirs.find(dir))
+    return true;
+  int wd = inotify_add_watch(notifyFd, dir.getData(), IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+  if(wd == -1)
+    return false;
+  watchedDirs.append(dir, wd);
+  watches.append(wd, dir);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Server::unwatch(int wd)
+{
+#ifdef __linux
+  Map<int, String>::Node* node = watches.find(wd);
+  if(!node)
+    return;
+  inotify_rm_watch(notifyFd, wd);
+  watchedDirs.remove(watchedDirs.find(node->data));
+  watches.remove(node);
+#endif
+}
+
+void Server::readNotifications()
+{
+#ifdef __linux
+  bool reload = false;
+  char buffer[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+  for(;;)
+  {
+    ssize_t size = read(notifyFd, buffer, sizeof(buffer));
+    if(size <= 0)
+      break;
+    for(char* pos = buffer; pos < buffer + size;)
+    {
+      const struct inotify_event* event = (const struct inotify_event*)pos;
+      pos += sizeof(struct inotify_event) + event->len;
+      if(event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+      {
+        if(event->mask & (IN_MOVE_SELF | IN_IGNORED))
+          unwatch(event->wd);
+        if(event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF))
+        {
+          // the changed files are unknown
+          File::enableStatusCache(false);
+          File::enableStatusCache(true);
+          reload = true;
+        }
+        continue;
+      }
+      Map<int, String>::Node* node = watches.find(event->wd);
+      if(!node || !event->len)
+        continue;
+      String name(event->name, -1);
+      String path = node->data == "." ? name : node->data + "/" + name;
+      File::invalidateStatus(path);
+      if(File::simplifyPath(path) == File::simplifyPath(file))
+        reload = true;
+    }
+  }
+  if(reload)
+  {
+    watch(File::getDirname(file));
+    loadEngine();
+  }
+#endif
+}
+
+int Server::serve(int connectionFd, BuildFunction build, List<String>& usedFiles)
+{
+#ifdef __linux
+  // receive the request
+  unsigned int header[2];
+  unsigned int size;
+  char data[sizeof(header) + sizeof(size)];
+  struct iovec iov = {data, sizeof(data)};
+  int fds[2];
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if(recvmsg(connectionFd, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(data))
+    return EXIT_FAILURE;
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if(!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    return EXIT_FAILURE;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  memcpy(header, data, sizeof(header));
+  memcpy(&size, data + sizeof(header), sizeof(size));
+  String request;
+  if(!readAll(connectionFd, request.getData(size), size))
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return EXIT_FAILURE;
+  }
+  request.setLength(size);
+
+  // apply the changes since the last build
+  readNotifications();
+
+  // execute the build in a child process
+  int pipeFds[2];
+  if(pipe2(pipeFds, O_CLOEXEC) != 0)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return EXIT_FAILURE;
+  }
+  pid_t pid = fork();
+  if(pid == 0)
+  {
+    setpgid(0, 0);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    close(socketFd);
+    close(notifyFd);
+    close(pipeFds[0]);
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+
+    // unpack the command line arguments and the environment variables
+    Array<char*> argv;
+    char* pos = (char*)request.getData();
+    char* end = pos + size;
+    for(unsigned int i = 0; i < header[0] && pos < end; ++i, pos += strlen(pos) + 1)
+      argv.append(pos);
+    argv.append(0);
+    clearenv();
+    for(unsigned int i = 0; i < header[1] && pos < end; ++i, pos += strlen(pos) + 1)
+      putenv(pos);
+
+    int exitCode = build((int)argv.getSize() - 1, argv.getFirst(), this);
+    fflush(stdout);
+    fflush(stderr);
+
+    // report the files used by the build
+    List<String> files;
+    File::getNewCachedFiles(files);
+    String report;
+    for(const List<String>::Node* i = files.getFirst(); i; i = i->getNext())
+      report.append(i->data.getData(), i->data.getLength() + 1);
+    writeAll(pipeFds[1], report.getData(), report.getLength());
+    _exit(exitCode);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(pipeFds[1]);
+  if(pid == -1)
+  {
+    close(pipeFds[0]);
+    return EXIT_FAILURE;
+  }
+
+  // wait for the build while watching the connection to the client
+  String report;
+  struct pollfd pollFds[2] = {{pipeFds[0], POLLIN, 0}, {connectionFd, POLLIN, 0}};
+  for(;;)
+  {
+    if(poll(pollFds, 2, -1) < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      break;
+    }
+    if(pollFds[1].revents)
+    {
+      // the client was terminated
+      kill(-pid, SIGTERM);
+      pollFds[1].fd = -1;
+    }
+    if(pollFds[0].revents)
+    {
+      char buffer[16384];
+      ssize_t i = read(pipeFds[0], buffer, sizeof(buffer));
+      if(i < 0 && errno == EINTR)
+        continue;
+      if(i <= 0)
+        break;
+      report.append(buffer, i);
+    }
+  }
+  close(pipeFds[0]);
+  int status;
+  while(waitpid(pid, &status, 0) == -1 && errno == EINTR);
+  int exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+
+  for(const char* pos = report.getData(), * end = pos + report.getLength(); pos < end; pos += strlen(pos) + 1)
+    usedFiles.append(String(pos, -1));
+  return exitCode;
+#else
+  return EXIT_FAILURE;
+#endif
+}
@@ -0,0 +1,71 @@
+
+#pragma once
+
+#include "Tools/List.h"
+#include "Tools/Map.h"
+#include "Tools/String.h"
+
+#include "Engine.h"
+
+/**
+* A resident build process for a directory. The server keeps the parsed marefile and a cache of the status of the
+* files used by the builds, which is updated using file change notifications (inotify). A build that is invoked in
+* the directory of the server is forwarded to the server over a Unix domain socket and is executed in a forked
+* process of the server, so that the marefile does not have to be parsed again and only the status of changed
+* files has to be read.
+*/
+class Server
+{
+public:
+  /**
+  * A function that executes a forwarded build
+  * @param argc The number of command line arguments of the build
+  * @param argv The command line arguments
+  * @param server The server that executes the build
+  * @return The exit code of the build
+  */
+  typedef int (*BuildFunction)(int argc, char* argv[], Server* server);
+
+  Server(const String& file, Engine::ErrorHandler errorHandler, void* userData);
+
+  ~Server();
+
+  /**
+  * Serves builds until the server is terminated
+  * @param build The function that executes a forwarded build
+  * @return Whether the server could be started
+  */
+  bool run(BuildFunction build);
+
+  /**
+  * Returns the parsed marefile
+  * @param file The path of the marefile that is requested by a build
+  * @return The engine with the parsed marefile or \c 0 if \c file is not the marefile of the server
+  */
+  Engine* getEngine(const String& file);
+
+  /**
+  * Forwards a build to the server of the current directory (if there is one)
+  * @param argc The number of command line arguments of the build
+  * @param argv The command line arguments
+  * @param exitCode The exit code of the build
+  * @return Whether the build was executed by a server
+  */
+  static bool forward(int argc, char* argv[], int& exitCode);
+
+private:
+  String file;
+  Engine::ErrorHandler errorHandler;
+  void* errorUserData;
+  Engine* engine;
+  int socketFd;
+  int notifyFd;
+  Map<int, String> watches; /**< The watched directories by watch descriptor */
+  Map<String, int> watchedDirs;
+
+  void loadEngine();
+  bool watch(const String& dir);
+  void unwatch(int wd);
+  void readNotifications();
+  int serve(int connectionFd, BuildFunction build, List<String>& usedFiles);
+};
@@ -0,0 +1,93 @@
+
+#include <cstdio>
+
+#include "Tools/Clock.h"
+
+#include "Stats.h"
+#include "Trace.h"
+
+Stats::Stats() : startTime(Clock::getMicroseconds()), evaluationTime(0), executionTime(0), commandTime(0), cpuTime(0), checkedRules(0), executedRules(0) {}
+
+void Stats::addCommand(const String& target, const String& rule, const String& command, long long duration, long long cpuTime)
+{
+  Command& entry = commands.append();
+  entry.target = target;
+  entry.rule = rule;
+  entry.command = command;
+  entry.duration = duration;
+  entry.cpuTime = cpuTime;
+  commandTime += duration;
+  this->cpuTime += cpuTime;
+
+  Map<String, TargetStats>::Node* node = targets.find(target);
+  TargetStats& targetStats = node ? node->data : targets.append(target);
+  ++targetStats.commands;
+  targetStats.duration += duration;
+  targetStats.cpuTime += cpuTime;
+}
+
+void Stats::addRule(bool executed)
+{
+  ++checkedRules;
+  if(executed)
+    ++executedRules;
+}
+
+void Stats::print(bool json)
+{
+  long long wallTime = Clock::getMicroseconds() - startTime;
+  double parallelism = executionTime > 0 ? (double)commandTime / (double)executionTime : 0.;
+  commands.sort(Command::compare);
+
+  if(json)
+  {
+    String buffer;
+    buffer.format(512, "{\"wallTime\":%.6f,\"evaluationTime\":%.6f,\"executionTime\":%.6f,\"commandTime\":%.6f,\"cpuTime\":%.6f,\"parallelism\":%.3f,\"checkedRules\":%u,\"executedRules\":%u,\"slowestCommands\":[",
+      wallTime / 1000000., evaluationTime / 1000000., executionTime / 1000000., commandTime / 1000000., cpuTime / 1000000., parallelism, checkedRules, executedRules);
+    unsigned int count = 0;
+    for(const List<Command>::Node* i = commands.getFirst(); i && count < slowestCommands; i = i->getNext(), ++count)
+    {
+      if(count)
+        buffer.append(',');
+      buffer.append("{\"target\":");
+      Trace::appendJsonString(buffer, i->data.target);
+      buffer.append(",\"rule\":");
+      Trace::appendJsonString(buffer, i->data.rule);
+      buffer.append(",\"command\":");
+      Trace::appendJsonString(buffer, i->data.command);
+      buffer.append(String().format(128, ",\"duration\":%.6f,\"cpuTime\":%.6f}", i->data.duration / 1000000., i->data.cpuTime / 1000000.));
+    }
+    buffer.append("],\"targets\":{");
+    for(const Map<String, TargetStats>::Node* i = targets.getFirst(); i; i = i->getNext())
+    {
+      if(i != targets.getFirst())
+        buffer.append(',');
+      Trace::appendJsonString(buffer, i->key);
+      buffer.append(String().format(128, ":{\"commands\":%u,\"duration\":%.6f,\"cpuTime\":%.6f}", i->data.commands, i->data.duration / 1000000., i->data.cpuTime / 1000000.));
+    }
+    buffer.append("}}\n");
+    fputs(buffer.getData(), stdout);
+  }
+  else
+  {
+    printf("Build statistics:\n");
+    printf("  wall time:        %.3f s (evaluation %.3f s, execution %.3f s)\n", wallTime / 1000000., evaluationTime / 1000000., executionTime / 1000000.);
+    printf("  command time:     %.3f s (cpu time %.3f s)\n", commandTime / 1000000., cpuTime / 1000000.);
+    printf("  parallelism:      %.2f\n", parallelism);
+    printf("  rules:            %u checked, %u executed\n", checkedRules, executedRules);
+    if(!commands.isEmpty())
+    {
+      printf("  slowest commands:\n");
+      unsigned int count = 0;
+      for(const List<Command>::Node* i = commands.getFirst(); i && count < slowestCommands; i = i->getNext(), ++count)
+        printf("    %8.3f s  %s: %s\n", i->data.duration / 1000000., i->data.target.getData(), i->data.rule.getData());
+    }
+    if(!targets.isEmpty())
+    {
+      printf("  targets:\n");
+      for(const Map<String, TargetStats>::Node* i = targets.getFirst(); i; i = i->getNext())
+        printf("    %8.3f s  %s (%u commands, cpu time %.3f s)\n", i->data.duration / 1000000., i->key.getData(), i->data.commands, i->data.cpuTime / 1000000.);
+    }
+  }
+  fflush(stdout);
+}
@@ -0,0 +1,76 @@
+
+#pragma once
+
+#include "Tools/List.h"
+#include "Tools/Map.h"
+#include "Tools/String.h"
+
+/** A collector for performance statistics of a build, which are printed at the end of the build */
+class Stats
+{
+public:
+  Stats();
+
+  /**
+  * Adds an executed command
+  * @param target The target of the rule of the command
+  * @param rule The name of the rule
+  * @param command The command line
+  * @param duration The execution time (wall time) in microseconds
+  * @param cpuTime The processor time used by the command in microseconds
+  */
+  void addCommand(const String& target, const String& rule, const String& command, long long duration, long long cpuTime);
+
+  /**
+  * Adds a rule that was checked
+  * @param executed Whether the rule was applied (i.e. whether its output files were outdated)
+  */
+  void addRule(bool executed);
+
+  void addEvaluationTime(long long duration) {evaluationTime += duration;}
+  void addExecutionTime(long long duration) {executionTime += duration;}
+
+  /**
+  * Prints the statistics
+  * @param json Whether the statistics should be printed as JSON object
+  */
+  void print(bool json);
+
+private:
+  class Command
+  {
+  public:
+    String target;
+    String rule;
+    String command;
+    long long duration;
+    long long cpuTime;
+
+    static int compare(const Command& a, const Command& b)
+    {
+      return a.duration > b.duration ? -1 : a.duration < b.duration ? 1 : 0;
+    }
+  };
+
+  class TargetStats
+  {
+  public:
+    unsigned int commands;
+    long long duration;
+    long long cpuTime;
+
+    TargetStats() : commands(0), duration(0), cpuTime(0) {}
+  };
+
+  long long startTime;
+  long long evaluationTime;
+  long long executionTime;
+  long long commandTime; /**< The sum of the execution times of all commands */
+  long long cpuTime;
+  unsigned int checkedRules;
+  unsigned int executedRules;
+  List<Command> commands;
+  Map<String, TargetStats> targets;
+
+  static const unsigned int slowestCommands = 10;
+};
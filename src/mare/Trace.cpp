@@ -0,0 +1,99 @@
+
+#include <cstdio>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Tools/Clock.h"
+
+#include "Trace.h"
+
+Trace::Trace() : baseTime(Clock::getMicroseconds()), hasEvents(false) {}
+
+Trace::~Trace()
+{
+  if(!file.isOpen())
+    return;
+  buffer.append("\n]}\n");
+  flush();
+}
+
+bool Trace::open(const String& file)
+{
+  if(!this->file.open(file, File::writeFlag))
+    return false;
+  buffer.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  return true;
+}
+
+void Trace::addEvent(const char* category, const String& name, long long startTime, long long endTime, unsigned int thread, const Map<String, String>* args)
+{
+  if(!file.isOpen())
+    return;
+#ifdef _WIN32
+  unsigned int pid = (unsigned int)GetCurrentProcessId();
+#else
+  unsigned int pid = (unsigned int)getpid();
+#endif
+  if(hasEvents)
+    buffer.append(',');
+  buffer.append('\n');
+  hasEvents = true;
+  buffer.append("{\"name\":");
+  appendJsonString(buffer, name);
+  buffer.append(String().format(256, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%u,\"tid\":%u", category, startTime - baseTime, endTime - startTime, pid, thread));
+  if(args)
+  {
+    buffer.append(",\"args\":{");
+    for(const Map<String, String>::Node* i = args->getFirst(); i; i = i->getNext())
+    {
+      if(i != args->getFirst())
+        buffer.append(',');
+      appendJsonString(buffer, i->key);
+      buffer.append(':');
+      appendJsonString(buffer, i->data);
+    }
+    buffer.append('}');
+  }
+  buffer.append('}');
+  if(buffer.getLength() >= 65536)
+    flush();
+}
+
+void Trace::flush()
+{
+  file.write(buffer);
+  buffer.clear();
+}
+
+void Trace::appendJsonString(String& buffer, const String& str)
+{
+  buffer.append('"');
+  for(const char* s = str.getData(); *s; ++s)
+    switch(*s)
+    {
+    case '"':
+      buffer.append("\\\"");
+      break;
+    case '\\':
+      buffer.append("\\\\");
+      break;
+    case '\n':
+      buffer.append("\\n");
+      break;
+    case '\r':
+      buffer.append("\\r");
+      break;
+    case '\t':
+      buffer.append("\\t");
+      break;
+    default:
+      if((unsigned char)*s < 0x20)
+        buffer.append(String().format(8, "\\u%04x", (unsigned int)(unsigned char)*s));
+      else
+        buffer.append(*s);
+    }
+  buffer.append('"');
+}
@@ -0,0 +1,49 @@
+
+#pragma once
+
+#include "Tools/File.h"
+#include "Tools/Map.h"
+#include "Tools/String.h"
+
+/**
+* A recorder for a timeline of the build in the Chrome trace event format (which can be viewed with Perfetto or
+* chrome://tracing). Each event is a complete event ("ph":"X") on a thread, where thread \c 0 is used for the
+* phases of mare itself and thread \c n is used for the commands executed in job slot \c n.
+*/
+class Trace
+{
+public:
+  Trace();
+
+  /** Completes and closes the trace file */
+  ~Trace();
+
+  /**
+  * Creates the trace file
+  * @param file The path of the trace file
+  * @return Whether the file could be created
+  */
+  bool open(const String& file);
+
+  /**
+  * Adds an event to the trace
+  * @param category The category of the event (e.g. "command")
+  * @param name The name of the event
+  * @param startTime The start time of the event (see \c Clock::getMicroseconds())
+  * @param endTime The end time of the event
+  * @param thread The thread (or job slot) of the event
+  * @param args Additional information about the event
+  */
+  void addEvent(const char* category, const String& name, long long startTime, long long endTime, unsigned int thread = 0, const Map<String, String>* args = 0);
+
+  /** Appends a string as quoted and escaped JSON string */
+  static void appendJsonString(String& buffer, const String& str);
+
+private:
+  File file;
+  String buffer;
+  long long baseTime;
+  bool hasEvents;
+
+  void flush();
+};